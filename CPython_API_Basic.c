@@ -35,18 +35,2142 @@
  The next thing we add to our module file is the C function that will be called when the Python expression spam.system(string) is evaluated:
 */ 
 
-static PyObject *
+/*
+ Rather than unpacking a tuple of arguments with PyArg_ParseTuple(), the function is registered with METH_FASTCALL, and its argument conversion is
+ generated by CPython_API_Fastcall_Clinic.py from the block below; spam_system_impl() receives the command as a C string.
+ The other functions of the module are declared the same way.
+*/
+
+static int spam_shell(const char *command);
+
+/*[fastcall input]
+spam.system
+
+    command: str
+    /
+
+Execute a shell command.
+[fastcall start generated code]*/
+#ifndef FASTCALL_SUPPORT_DEFINED
+#define FASTCALL_SUPPORT_DEFINED
+
+/* Shared helpers of the generated wrappers; emitted once per translation unit */
+
+static inline int
+_fastcall_intern(PyObject **interned, const char * const *names, Py_ssize_t n)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        if (interned[i] == NULL) {
+            interned[i] = PyUnicode_InternFromString(names[i]);
+
+            if (interned[i] == NULL)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_match(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                PyObject *kwnames, PyObject **interned, Py_ssize_t posonly,
+                Py_ssize_t nparams, PyObject **slots)
+{
+    Py_ssize_t k, i, nkw = PyTuple_GET_SIZE(kwnames);
+
+    for (k = 0; k < nkw; k++) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+
+        /* Keyword names in calls are almost always interned as well */
+
+        for (i = posonly; i < nparams; i++) {
+            if (interned[i] == key)
+                break;
+        }
+
+        if (i == nparams) {
+            for (i = posonly; i < nparams; i++) {
+                if (PyUnicode_Compare(interned[i], key) == 0)
+                    break;
+            }
+        }
+
+        if (i == nparams) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() got an unexpected keyword argument '%S'",
+                         fname, key);
+
+            return -1;
+        }
+
+        if (i < nargs) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for %s() given by name ('%S') and position (%zd)",
+                         fname, key, i + 1);
+
+            return -1;
+        }
+
+        slots[i] = args[nargs + k];
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_str(const char *fname, const char *pname, PyObject *arg, const char **out)
+{
+    Py_ssize_t size;
+
+    if (!PyUnicode_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be str, not %.50s",
+                     fname, pname, Py_TYPE(arg)->tp_name);
+
+        return -1;
+    }
+
+    *out = PyUnicode_AsUTF8AndSize(arg, &size);
 
-spam_system(PyObject *self, PyObject *args)
+    if (*out == NULL)
+        return -1;
 
+    if (strlen(*out) != (size_t) size) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_int(const char *fname, const char *pname, PyObject *arg, int *out)
+{
+    long value;
+
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    value = PyLong_AsLong(arg);
+
+    if (value == -1 && PyErr_Occurred())
+        return -1;
+
+    if (value > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is greater than maximum");
+
+        return -1;
+    }
+
+    if (value < INT_MIN) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is less than minimum");
+
+        return -1;
+    }
+
+    *out = (int) value;
+
+    return 0;
+}
+
+static inline int
+_fastcall_ssize_t(const char *fname, const char *pname, PyObject *arg, Py_ssize_t *out)
+{
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    *out = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (*out == -1 && PyErr_Occurred())
+        return -1;
+
+    return 0;
+}
+
+#endif /* FASTCALL_SUPPORT_DEFINED */
+
+PyDoc_STRVAR(spam_system__doc__,
+"system(command, /)\n"
+"--\n"
+"\n"
+"Execute a shell command.");
+
+#define SPAM_SYSTEM_METHODDEF    \
+    {"system", (PyCFunction)(void(*)(void))spam_system, METH_FASTCALL, spam_system__doc__},
+
+static PyObject *
+spam_system_impl(PyObject *module, const char *command);
+
+static PyObject *
+spam_system(PyObject *module, PyObject *const *args, Py_ssize_t nargs)
 {
+    PyObject *return_value = NULL;
+    PyObject *argsbuf[1] = {NULL};
     const char *command;
+    Py_ssize_t i;
+
+    if (nargs != 1) {
+        PyErr_Format(PyExc_TypeError, "system() takes exactly 1 argument (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    if (_fastcall_str("system", "command", argsbuf[0], &command) < 0)
+        goto exit;
+
+    return_value = spam_system_impl(module, command);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "system() missing required argument '%s' (pos %zd)",
+                 (const char *[]){"command"}[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_system_impl(PyObject *module, const char *command)
+
+{
     int sts;
 
-    if (!PyArg_ParseTuple(args, "s", &command))
-        return NULL;
+    /* spam_shell() only touches C data, so other Python threads may run meanwhile */
 
-    sts = system(command);
+    Py_BEGIN_ALLOW_THREADS
+    sts = spam_shell(command);
+    Py_END_ALLOW_THREADS
 
     return PyLong_FromLong(sts);
 }
+
+/*
+ Accounting for the commands spam runs:
+ system() reaps its child internally, so there is no way to tell what a command cost.
+ When accounting is switched on with spam.set_accounting(True), every command started by this module is reaped with wait4() instead, and its resource
+ usage is added to a small in-module table keyed by the command name (the basename of the program, or the first word of a shell command).
+ For every name the table keeps the number of runs, the total user and system time, the largest maximum resident set size and a histogram of wall-clock
+ latencies, where bucket i counts the commands that took between 2**i and 2**(i+1) microseconds.
+ The wall-clock time of a command ends when it is reaped, so commands that run side by side (spam.run_batch() and the stages of a pipeline) are each
+ watched through a pidfd and reaped as soon as they exit, in whatever order that happens.
+ spam.stats(reset=False) returns the table as a dictionary.
+ The table has a fixed size and is protected by a plain mutex, because children are reaped with the GIL released; recording a command costs one hash
+ lookup and a few additions, so accounting is cheap enough to leave on.
+ Names that do not fit in the table any more are counted under "<other>".
+ On Linux the maximum resident set size of a child includes the memory it had before exec(); since posix_spawn() starts the child in the parent's
+ address space, that number is never smaller than the size of the calling process.
+ It is therefore only an upper bound on what the command itself used, and spam.stats() reports it under the name "maxrss_upper_bound" to say so.
+ Turning accounting on does not change what spam.system() returns: the command is still run by /bin/sh with SIGINT and SIGQUIT ignored in the caller,
+ and a shell that cannot be started is reported as exit status 127, as system() does.
+*/
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+extern char **environ;
+
+#define SPAM_STATS_SLOTS 256
+#define SPAM_STATS_NAME 32
+#define SPAM_STATS_BUCKETS 32
+
+typedef struct {
+    char name[SPAM_STATS_NAME];
+    uint64_t count;
+    uint64_t utime_us, stime_us, wall_us;
+    long maxrss;                                  /* kilobytes, an upper bound (see above) */
+    uint64_t latency[SPAM_STATS_BUCKETS];
+} SpamStatsEntry;
+
+/* The extra entry at the end is "<other>" */
+
+static SpamStatsEntry spam_stats_table[SPAM_STATS_SLOTS + 1];
+static pthread_mutex_t spam_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static int spam_accounting = 0;
+
+/*
+ Everything needed to reap one child; slot is -1 when the child is not accounted.
+ pid is 0 once the child has been reaped, pidfd is -1 unless the child is watched, and index is its position in a batch or pipeline.
+*/
+
+typedef struct {
+    pid_t pid;
+    int pidfd;
+    int slot;
+    Py_ssize_t index;
+    uint64_t start_us;
+} SpamChild;
+
+static uint64_t
+
+spam_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Find or claim the table entry for the program run by argv */
+
+static int
+
+spam_stats_slot(char **argv)
+{
+    const char *name = argv[0], *end, *slash;
+    size_t len, i;
+    uint64_t hash = 14695981039346656037ULL;
+    int slot = SPAM_STATS_SLOTS;
+
+    /* A shell command is accounted under its first word */
+
+    if (argv[1] != NULL && argv[2] != NULL &&
+        strcmp(argv[0], "/bin/sh") == 0 && strcmp(argv[1], "-c") == 0) {
+        name = argv[2] + strspn(argv[2], " \t\n");
+    }
+
+    end = name + strcspn(name, " \t\n");
+
+    for (slash = name; slash < end; slash++) {
+        if (*slash == '/')
+            name = slash + 1;
+    }
+
+    len = end - name;
+
+    if (len == 0)
+        return SPAM_STATS_SLOTS;
+
+    if (len >= SPAM_STATS_NAME)
+        len = SPAM_STATS_NAME - 1;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char) name[i]) * 1099511628211ULL;
+
+    pthread_mutex_lock(&spam_stats_lock);
+
+    for (i = 0; i < SPAM_STATS_SLOTS; i++) {
+        SpamStatsEntry *e = &spam_stats_table[(hash + i) % SPAM_STATS_SLOTS];
+
+        if (e->name[0] == '\0') {
+            memcpy(e->name, name, len);
+            e->name[len] = '\0';
+        }
+        else if (strncmp(e->name, name, len) != 0 || e->name[len] != '\0') {
+            continue;
+        }
+
+        slot = (int) ((hash + i) % SPAM_STATS_SLOTS);
+        break;
+    }
+
+    pthread_mutex_unlock(&spam_stats_lock);
+
+    return slot;
+}
+
+static void
+
+spam_stats_record(SpamChild *child, struct rusage *ru)
+{
+    SpamStatsEntry *e = &spam_stats_table[child->slot];
+    uint64_t wall = spam_now_us() - child->start_us;
+    int bucket = 0;
+
+    while (bucket < SPAM_STATS_BUCKETS - 1 && (wall >> (bucket + 1)) != 0)
+        bucket++;
+
+    pthread_mutex_lock(&spam_stats_lock);
+
+    e->count++;
+    e->utime_us += (uint64_t) ru->ru_utime.tv_sec * 1000000 + ru->ru_utime.tv_usec;
+    e->stime_us += (uint64_t) ru->ru_stime.tv_sec * 1000000 + ru->ru_stime.tv_usec;
+    e->wall_us += wall;
+
+    if (ru->ru_maxrss > e->maxrss)
+        e->maxrss = ru->ru_maxrss;
+
+    e->latency[bucket]++;
+
+    pthread_mutex_unlock(&spam_stats_lock);
+}
+
+/*
+ All commands are started and reaped through these two functions.
+ A string command always has "/bin/sh" as argv[0], so the PATH search done by posix_spawnp() only matters for argv vectors.
+ They only touch C data and may be called with the GIL released.
+ spam_child_spawn() returns 0, or the error of posix_spawnp() with the pid set to -1.
+*/
+
+static int
+
+spam_child_spawn(SpamChild *child, char **argv,
+                 const posix_spawn_file_actions_t *actions, const posix_spawnattr_t *attr)
+{
+    int err;
+
+    child->pidfd = -1;
+    child->slot = spam_accounting ? spam_stats_slot(argv) : -1;
+    child->start_us = (child->slot >= 0) ? spam_now_us() : 0;
+
+    if ((err = posix_spawnp(&child->pid, argv[0], actions, attr, argv, environ)) != 0)
+        child->pid = -1;
+
+    return err;
+}
+
+/*
+ Python ignores SIGPIPE and SIGXFSZ, and a child inherits ignored signals across exec: a producer whose reader has gone would get EPIPE instead of being
+ killed, and most of them report that and carry on, or loop forever.
+ Like the subprocess module, the commands started by run_batch(), system_async() and the pipelines get the default dispositions back.
+ spam.system() is left as system() leaves it.
+*/
+
+static void
+
+spam_spawnattr_init(posix_spawnattr_t *attr)
+{
+    sigset_t defaults;
+
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+#ifdef SIGXFSZ
+    sigaddset(&defaults, SIGXFSZ);
+#endif
+
+    posix_spawnattr_init(attr);
+    posix_spawnattr_setsigdefault(attr, &defaults);
+    posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSIGDEF);
+}
+
+/* Open a pidfd for a running child; without one (before Linux 5.3) the child can still be reaped, just not waited for together with others */
+
+static void
+
+spam_child_watch(SpamChild *child)
+{
+    if (child->pid > 0)
+        child->pidfd = (int) syscall(SYS_pidfd_open, child->pid, 0);
+}
+
+/* Returns the wait status, 0 if options contains WNOHANG and the child is still running, or -1 */
+
+static int
+
+spam_child_wait(SpamChild *child, int options)
+{
+    struct rusage ru;
+    pid_t pid;
+    int sts;
+
+    if (child->pid <= 0) {
+        child->pid = 0;
+
+        return -1;
+    }
+
+    while ((pid = wait4(child->pid, &sts, options, &ru)) < 0) {
+        if (errno != EINTR) {
+            sts = -1;
+            goto reaped;
+        }
+    }
+
+    if (pid == 0)
+        return 0;
+
+    if (child->slot >= 0)
+        spam_stats_record(child, &ru);
+
+reaped:
+    if (child->pidfd >= 0)
+        close(child->pidfd);
+
+    child->pid = 0;
+    child->pidfd = -1;
+
+    return sts;
+}
+
+/*
+ Reap every one of the n children that has exited, storing its status in statuses[child->index], so that each child is stamped when it actually
+ exits rather than when the children started before it have been waited for.
+ Watched children are polled together with fd, if fd is not -1; *ready is set when fd is readable.
+ Unwatched children are only waited for when there is nothing else to poll.
+ Returns the number of children reaped, which is 0 only when fd became readable or nothing is left to wait for, or -1 if poll() was interrupted.
+*/
+
+static Py_ssize_t
+
+spam_children_reap(SpamChild *children, Py_ssize_t n, struct pollfd *fds, int fd, int *ready, int *statuses)
+{
+    Py_ssize_t i, j, nfds = 0, reaped = 0;
+
+    *ready = 0;
+
+    for (i = 0; i < n; i++) {
+        SpamChild *child = &children[i];
+
+        if (child->pid < 0) {
+            statuses[child->index] = spam_child_wait(child, 0);
+            reaped++;
+        }
+        else if (child->pid > 0 && child->pidfd >= 0) {
+            fds[nfds].fd = child->pidfd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+    }
+
+    if (reaped > 0)
+        return reaped;
+
+    if (fd >= 0) {
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+
+    if (nfds == 0 || poll(fds, nfds, -1) < 0) {
+        if (nfds > 0 && errno == EINTR)
+            return -1;
+
+        /* Fall back to waiting for the first child, as if none were watched */
+
+        if (fd >= 0) {
+            *ready = 1;
+
+            return 0;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (children[i].pid > 0) {
+                statuses[children[i].index] = spam_child_wait(&children[i], 0);
+
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+
+    for (i = 0, j = 0; i < n; i++) {
+        SpamChild *child = &children[i];
+
+        if (child->pid > 0 && child->pidfd >= 0) {
+            if (fds[j++].revents != 0) {
+                statuses[child->index] = spam_child_wait(child, 0);
+                reaped++;
+            }
+        }
+    }
+
+    if (fd >= 0 && fds[nfds - 1].revents != 0)
+        *ready = 1;
+
+    return reaped;
+}
+
+/*
+ spam.system() and PySpam_System() go through spam_shell(); with accounting off it is still a plain system() call.
+ With accounting on, the shell is started the way system() starts it: SIGINT and SIGQUIT are ignored and SIGCHLD is blocked in the caller while the
+ command runs, the child gets the default dispositions and the caller's signal mask back, and a failure to start it yields the status of exit(127).
+ As in glibc, the two signals are ignored once for all threads that are in spam_shell() at the same time, and restored by the last one to leave.
+*/
+
+static pthread_mutex_t spam_shell_lock = PTHREAD_MUTEX_INITIALIZER;
+static int spam_shell_active = 0;
+static struct sigaction spam_shell_intr, spam_shell_quit;
+
+static int
+
+spam_shell(const char *command)
+{
+    char *argv[] = {"/bin/sh", "-c", (char *) command, NULL};
+    struct sigaction ignore;
+    sigset_t chld, omask, defaults;
+    posix_spawnattr_t attr;
+    SpamChild child;
+    int sts;
+
+    if (!spam_accounting)
+        return system(command);
+
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+
+    pthread_mutex_lock(&spam_shell_lock);
+
+    if (spam_shell_active++ == 0) {
+        sigaction(SIGINT, &ignore, &spam_shell_intr);
+        sigaction(SIGQUIT, &ignore, &spam_shell_quit);
+    }
+
+    pthread_mutex_unlock(&spam_shell_lock);
+
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &chld, &omask);
+
+    sigemptyset(&defaults);
+
+    if (spam_shell_intr.sa_handler != SIG_IGN)
+        sigaddset(&defaults, SIGINT);
+
+    if (spam_shell_quit.sa_handler != SIG_IGN)
+        sigaddset(&defaults, SIGQUIT);
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &omask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+    spam_child_spawn(&child, argv, NULL, &attr);
+
+    posix_spawnattr_destroy(&attr);
+
+    sts = (child.pid < 0) ? (127 << 8) : spam_child_wait(&child, 0);
+
+    pthread_mutex_lock(&spam_shell_lock);
+
+    if (--spam_shell_active == 0) {
+        sigaction(SIGINT, &spam_shell_intr, NULL);
+        sigaction(SIGQUIT, &spam_shell_quit, NULL);
+    }
+
+    pthread_mutex_unlock(&spam_shell_lock);
+
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+
+    return sts;
+}
+
+/*[fastcall input]
+spam.set_accounting
+
+    enabled: bool
+    /
+
+Switch per-command resource accounting on or off.
+
+Return the previous setting.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_set_accounting__doc__,
+"set_accounting(enabled, /)\n"
+"--\n"
+"\n"
+"Switch per-command resource accounting on or off.\n"
+"\n"
+"Return the previous setting.");
+
+#define SPAM_SET_ACCOUNTING_METHODDEF    \
+    {"set_accounting", (PyCFunction)(void(*)(void))spam_set_accounting, METH_FASTCALL, spam_set_accounting__doc__},
+
+static PyObject *
+spam_set_accounting_impl(PyObject *module, int enabled);
+
+static PyObject *
+spam_set_accounting(PyObject *module, PyObject *const *args, Py_ssize_t nargs)
+{
+    PyObject *return_value = NULL;
+    PyObject *argsbuf[1] = {NULL};
+    int enabled;
+    Py_ssize_t i;
+
+    if (nargs != 1) {
+        PyErr_Format(PyExc_TypeError, "set_accounting() takes exactly 1 argument (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    enabled = PyObject_IsTrue(argsbuf[0]);
+    if (enabled < 0)
+        goto exit;
+
+    return_value = spam_set_accounting_impl(module, enabled);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "set_accounting() missing required argument '%s' (pos %zd)",
+                 (const char *[]){"enabled"}[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_set_accounting_impl(PyObject *module, int enabled)
+{
+    int previous = spam_accounting;
+
+    spam_accounting = enabled;
+
+    return PyBool_FromLong(previous);
+}
+
+/*[fastcall input]
+spam.stats
+
+    reset: bool = 0
+
+Return the resource usage recorded per command name.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_stats__doc__,
+"stats(reset=False)\n"
+"--\n"
+"\n"
+"Return the resource usage recorded per command name.");
+
+#define SPAM_STATS_METHODDEF    \
+    {"stats", (PyCFunction)(void(*)(void))spam_stats, METH_FASTCALL | METH_KEYWORDS, spam_stats__doc__},
+
+static PyObject *
+spam_stats_impl(PyObject *module, int reset);
+
+static PyObject *
+spam_stats(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *return_value = NULL;
+    static const char * const _keywords[] = {"reset"};
+    static PyObject *_interned[1];
+    PyObject *argsbuf[1] = {NULL};
+    int reset = 0;
+    Py_ssize_t i;
+
+    if (nargs > 1) {
+        PyErr_Format(PyExc_TypeError, "stats() takes at most 1 argument (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    if (kwnames != NULL) {
+        if (_fastcall_intern(_interned, _keywords, 1) < 0)
+            goto exit;
+
+        if (_fastcall_match("stats", args, nargs, kwnames, _interned, 0, 1, argsbuf) < 0)
+            goto exit;
+    }
+
+    if (argsbuf[0] != NULL) {
+        reset = PyObject_IsTrue(argsbuf[0]);
+        if (reset < 0)
+            goto exit;
+    }
+
+    return_value = spam_stats_impl(module, reset);
+    goto exit;
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_stats_impl(PyObject *module, int reset)
+{
+    SpamStatsEntry *snapshot;
+    PyObject *result;
+    int i, j;
+
+    /* Copy the table first, so the lock is never held while calling into Python */
+
+    snapshot = PyMem_New(SpamStatsEntry, SPAM_STATS_SLOTS + 1);
+
+    if (snapshot == NULL)
+        return PyErr_NoMemory();
+
+    pthread_mutex_lock(&spam_stats_lock);
+
+    memcpy(snapshot, spam_stats_table, sizeof(spam_stats_table));
+
+    /* The names stay, because children that are still running refer to their slot */
+
+    for (i = 0; reset && i <= SPAM_STATS_SLOTS; i++) {
+        SpamStatsEntry *e = &spam_stats_table[i];
+
+        memset(&e->count, 0, sizeof(*e) - offsetof(SpamStatsEntry, count));
+    }
+
+    pthread_mutex_unlock(&spam_stats_lock);
+
+    result = PyDict_New();
+
+    for (i = 0; result != NULL && i <= SPAM_STATS_SLOTS; i++) {
+        SpamStatsEntry *e = &snapshot[i];
+        PyObject *latency, *entry;
+
+        if (e->count == 0)
+            continue;
+
+        latency = PyList_New(SPAM_STATS_BUCKETS);
+
+        for (j = 0; latency != NULL && j < SPAM_STATS_BUCKETS; j++) {
+            PyObject *n = PyLong_FromUnsignedLongLong(e->latency[j]);
+
+            if (n == NULL)
+                Py_CLEAR(latency);
+            else
+                PyList_SET_ITEM(latency, j, n);
+        }
+
+        entry = (latency == NULL) ? NULL :
+            Py_BuildValue("{sKsdsdsdslsN}",
+                          "count", (unsigned long long) e->count,
+                          "utime", e->utime_us / 1e6,
+                          "stime", e->stime_us / 1e6,
+                          "wall", e->wall_us / 1e6,
+                          "maxrss_upper_bound", e->maxrss,
+                          "latency_us_log2", latency);
+
+        if (entry == NULL ||
+            PyDict_SetItemString(result, (i < SPAM_STATS_SLOTS) ? e->name : "<other>", entry) < 0)
+            Py_CLEAR(result);
+
+        Py_XDECREF(entry);
+    }
+
+    PyMem_Free(snapshot);
+
+    return result;
+}
+
+/*
+ Running many commands at once:
+ spam_system() runs one command at a time and waits for it, and every command pays for an extra /bin/sh process.
+ When a program has a whole batch of commands to run, it is better to hand them to the module in one call.
+ spam.run_batch(commands, max_parallel=N) starts up to N processes at a time with posix_spawn() (which uses vfork()-style cloning on Linux, so no
+ page tables are copied), waits for them with the GIL released, and returns one status per command, in the same order.
+ A command may be a string, which is run through /bin/sh -c exactly like spam.system(), or a sequence of strings, which is executed directly as an argv
+ vector without starting a shell at all.
+ The statuses have the same meaning as the value returned by spam.system().
+ A command that cannot be started (an argv vector naming a missing program, say) raises OSError, and so does KeyboardInterrupt or any other exception
+ raised by a signal handler while the batch runs; the commands still running are killed first.
+*/
+
+/*
+ Every command is converted into a NULL-terminated argv vector before the GIL is released.
+ The strings returned by PyUnicode_AsUTF8() belong to the string objects, so the vectors stay valid for as long as the tuple built by
+ spam_batch_prepare() is alive, even if the caller mutates the original list from another thread.
+*/
+
+static char **
+
+spam_batch_argv(PyObject *command, PyObject **keep)
+{
+    static char *shell_argv[] = {"/bin/sh", "-c", NULL, NULL};
+    Py_ssize_t i, n;
+    char **argv;
+
+    if (PyUnicode_Check(command)) {
+        const char *s = PyUnicode_AsUTF8(command);
+
+        if (s == NULL)
+            return NULL;
+
+        argv = PyMem_New(char *, 4);
+
+        if (argv == NULL) {
+            PyErr_NoMemory();
+
+            return NULL;
+        }
+
+        memcpy(argv, shell_argv, sizeof(shell_argv));
+        argv[2] = (char *) s;
+
+        Py_INCREF(command);
+        *keep = command;
+
+        return argv;
+    }
+
+    *keep = PySequence_Tuple(command);
+
+    if (*keep == NULL)
+        return NULL;
+
+    n = PyTuple_GET_SIZE(*keep);
+
+    if (n == 0) {
+        PyErr_SetString(PyExc_ValueError, "argv sequence must not be empty");
+
+        return NULL;
+    }
+
+    argv = PyMem_New(char *, n + 1);
+
+    if (argv == NULL) {
+        PyErr_NoMemory();
+
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        PyObject *item = PyTuple_GET_ITEM(*keep, i);
+
+        if (!PyUnicode_Check(item)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "argv items must be strings");
+            PyMem_Free(argv);
+
+            return NULL;
+        }
+
+        argv[i] = (char *) PyUnicode_AsUTF8(item);
+
+        if (argv[i] == NULL) {
+            PyMem_Free(argv);
+
+            return NULL;
+        }
+    }
+
+    argv[n] = NULL;
+
+    return argv;
+}
+
+/*
+ The window of running processes is an array of at most max_parallel children.
+ Each child is watched through a pidfd and reaped as soon as it exits, whatever its position, and its slot is refilled with the next command; the
+ status goes to the position the command had in the batch, so the statuses stay in order.
+ waitpid(-1, ...) is deliberately not used, because it would also reap children that belong to the rest of the program (for example those started by
+ the subprocess module).
+ Without pidfds (or the memory to poll them) the children are reaped in the order they were started instead.
+ spam_batch_step() runs with the GIL released until the batch is done (0), poll() is interrupted by a signal (EINTR), or a command cannot be started
+ (its errno, with *started left at the index of that command).
+*/
+
+static int
+
+spam_batch_step(char ***argvs, int *statuses, Py_ssize_t n, SpamChild *running, Py_ssize_t max_parallel,
+                struct pollfd *fds, const posix_spawnattr_t *attr, Py_ssize_t *started, Py_ssize_t *reaped)
+{
+    Py_ssize_t i, r;
+    int ready, err;
+
+    while (*reaped < n) {
+        for (i = 0; *started < n && i < max_parallel; i++) {
+            if (running[i].pid != 0)
+                continue;
+
+            if ((err = spam_child_spawn(&running[i], argvs[*started], NULL, attr)) != 0)
+                return err;
+
+            running[i].index = (*started)++;
+
+            if (fds != NULL)
+                spam_child_watch(&running[i]);
+        }
+
+        r = spam_children_reap(running, max_parallel, fds, -1, &ready, statuses);
+
+        if (r < 0)
+            return EINTR;
+
+        *reaped += r;
+    }
+
+    return 0;
+}
+
+/* Kill and reap the children of an abandoned batch; a child that has not been reaped keeps its pid, so the signal cannot hit another process */
+
+static void
+
+spam_batch_kill(SpamChild *running, Py_ssize_t max_parallel)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < max_parallel; i++) {
+        if (running[i].pid > 0)
+            kill(running[i].pid, SIGKILL);
+
+        spam_child_wait(&running[i], 0);
+    }
+}
+
+/*
+ Called with the GIL held, which is released while the commands run and reacquired whenever a signal interrupts the wait, so that Ctrl-C works as it
+ does for the pipelines below.
+ Returns 0, or -1 with an exception set if a command could not be started or a signal handler raised; the commands still running are then killed.
+*/
+
+static int
+
+spam_batch_run(char ***argvs, int *statuses, Py_ssize_t n,
+               SpamChild *running, Py_ssize_t max_parallel)
+{
+    struct pollfd *fds = PyMem_RawMalloc(max_parallel * sizeof(struct pollfd));
+    Py_ssize_t started = 0, reaped = 0, i;
+    posix_spawnattr_t attr;
+    int err;
+
+    for (i = 0; i < max_parallel; i++)
+        running[i].pid = 0;
+
+    spam_spawnattr_init(&attr);
+
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+        err = spam_batch_step(argvs, statuses, n, running, max_parallel, fds, &attr, &started, &reaped);
+        Py_END_ALLOW_THREADS
+
+        if (err != EINTR || PyErr_CheckSignals() < 0)
+            break;
+    }
+
+    if (err != 0) {
+        if (!PyErr_Occurred()) {
+            errno = err;
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, argvs[started][0]);
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        spam_batch_kill(running, max_parallel);
+        Py_END_ALLOW_THREADS
+    }
+
+    posix_spawnattr_destroy(&attr);
+    PyMem_RawFree(fds);
+
+    return (err != 0) ? -1 : 0;
+}
+
+/*[fastcall input]
+spam.run_batch
+
+    commands: object
+    max_parallel: Py_ssize_t = 0
+
+Run a batch of commands in parallel and return their exit statuses.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_run_batch__doc__,
+"run_batch(commands, max_parallel=0)\n"
+"--\n"
+"\n"
+"Run a batch of commands in parallel and return their exit statuses.");
+
+#define SPAM_RUN_BATCH_METHODDEF    \
+    {"run_batch", (PyCFunction)(void(*)(void))spam_run_batch, METH_FASTCALL | METH_KEYWORDS, spam_run_batch__doc__},
+
+static PyObject *
+spam_run_batch_impl(PyObject *module, PyObject *commands, Py_ssize_t max_parallel);
+
+static PyObject *
+spam_run_batch(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *return_value = NULL;
+    static const char * const _keywords[] = {"commands", "max_parallel"};
+    static PyObject *_interned[2];
+    PyObject *argsbuf[2] = {NULL, NULL};
+    PyObject *commands;
+    Py_ssize_t max_parallel = 0;
+    Py_ssize_t i;
+
+    if (nargs > 2) {
+        PyErr_Format(PyExc_TypeError, "run_batch() takes at most 2 arguments (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    if (kwnames != NULL) {
+        if (_fastcall_intern(_interned, _keywords, 2) < 0)
+            goto exit;
+
+        if (_fastcall_match("run_batch", args, nargs, kwnames, _interned, 0, 2, argsbuf) < 0)
+            goto exit;
+    }
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    commands = argsbuf[0];
+
+    if (argsbuf[1] != NULL) {
+        if (_fastcall_ssize_t("run_batch", "max_parallel", argsbuf[1], &max_parallel) < 0)
+            goto exit;
+    }
+
+    return_value = spam_run_batch_impl(module, commands, max_parallel);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "run_batch() missing required argument '%s' (pos %zd)",
+                 _keywords[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_run_batch_impl(PyObject *module, PyObject *commands, Py_ssize_t max_parallel)
+{
+    PyObject *keep = NULL, *result = NULL;
+    Py_ssize_t i, n;
+    char ***argvs = NULL;
+    int *statuses = NULL;
+    SpamChild *running = NULL;
+
+    commands = PySequence_Tuple(commands);
+
+    if (commands == NULL)
+        return NULL;
+
+    n = PyTuple_GET_SIZE(commands);
+
+    if (max_parallel <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        max_parallel = (ncpu > 0) ? ncpu : 1;
+    }
+
+    if (max_parallel > n)
+        max_parallel = (n > 0) ? n : 1;
+
+    keep = PyTuple_New(n);
+    argvs = PyMem_New(char **, n);
+    statuses = PyMem_New(int, n);
+    running = PyMem_New(SpamChild, max_parallel);
+
+    if (keep == NULL || argvs == NULL || statuses == NULL || running == NULL) {
+        if (keep != NULL)
+            PyErr_NoMemory();
+
+        n = 0;
+        goto done;
+    }
+
+    for (i = 0; i < n; i++) {
+        PyObject *owner = NULL;
+
+        argvs[i] = spam_batch_argv(PyTuple_GET_ITEM(commands, i), &owner);
+
+        if (owner != NULL)
+            PyTuple_SET_ITEM(keep, i, owner);
+
+        if (argvs[i] == NULL) {
+            n = i;
+            goto done;
+        }
+    }
+
+    if (spam_batch_run(argvs, statuses, n, running, max_parallel) < 0)
+        goto done;
+
+    result = PyList_New(n);
+
+    if (result == NULL)
+        goto done;
+
+    for (i = 0; i < n; i++) {
+        PyObject *sts = PyLong_FromLong(statuses[i]);
+
+        if (sts == NULL) {
+            Py_CLEAR(result);
+            break;
+        }
+
+        PyList_SET_ITEM(result, i, sts);
+    }
+
+done:
+    if (argvs != NULL) {
+        for (i = 0; i < n; i++)
+            PyMem_Free(argvs[i]);
+    }
+
+    PyMem_Free(argvs);
+    PyMem_Free(statuses);
+    PyMem_Free(running);
+
+    Py_XDECREF(keep);
+    Py_DECREF(commands);
+
+    return result;
+}
+
+/*
+ Waiting for commands from asyncio:
+ Even with the GIL released, spam.system() still blocks the calling thread until the command finishes, which stalls an asyncio event loop.
+ spam.system_async(command) starts the command with posix_spawn() and returns an asyncio future for its exit status instead.
+ On Linux a child process can be referred to by a file descriptor returned by pidfd_open(); the descriptor becomes readable when the child terminates.
+ The descriptor is registered with loop.add_reader(), so the loop's own selector tells us when the command is done: no thread is parked per command, and
+ each running command costs one file descriptor.
+ Exactly one callback is registered per descriptor, so completion wakes exactly the one coroutine awaiting that future.
+ Cancelling the future kills the command: its reader is removed, and the child is killed and reaped, which also closes the pidfd.
+ If the loop is closed before the command exits, the child is killed and reaped when the loop drops the reader callback.
+*/
+
+/*
+ The SpamChild lives in a capsule, whose destructor kills and reaps the child if nothing has reaped it yet, so no extra type is needed to carry it.
+ The reader callback is a builtin function whose self is a tuple (loop, future, capsule); the done callback of the future is one whose self is a
+ tuple (loop, capsule), since it is passed the future anyway and must not keep it alive.
+*/
+
+#define SPAM_ASYNC_CHILD "spam._async_child"
+
+static void
+
+spam_async_child_release(SpamChild *child)
+{
+    Py_BEGIN_ALLOW_THREADS
+
+    if (child->pid > 0)
+        kill(child->pid, SIGKILL);
+
+    spam_child_wait(child, 0);
+
+    Py_END_ALLOW_THREADS
+}
+
+static void
+
+spam_async_child_free(PyObject *capsule)
+{
+    SpamChild *child = PyCapsule_GetPointer(capsule, SPAM_ASYNC_CHILD);
+
+    spam_async_child_release(child);
+    PyMem_Free(child);
+}
+
+static PyObject *
+
+spam_system_async_done(PyObject *state, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *loop = PyTuple_GET_ITEM(state, 0);
+    PyObject *future = PyTuple_GET_ITEM(state, 1);
+    SpamChild *child = PyCapsule_GetPointer(PyTuple_GET_ITEM(state, 2), SPAM_ASYNC_CHILD);
+    PyObject *res;
+    int sts, done;
+
+    if (child == NULL)
+        return NULL;
+
+    /* Already killed and reaped by a cancellation */
+
+    if (child->pid == 0)
+        Py_RETURN_NONE;
+
+    res = PyObject_CallMethod(loop, "remove_reader", "i", child->pidfd);
+
+    if (res == NULL)
+        return NULL;
+
+    Py_DECREF(res);
+
+    /* The pidfd is readable, so the child has exited and can be reaped without blocking; this closes the pidfd */
+
+    sts = spam_child_wait(child, WNOHANG);
+
+    /* The result may have been set by someone else meanwhile; the child is reaped regardless */
+
+    res = PyObject_CallMethod(future, "done", NULL);
+
+    if (res == NULL)
+        return NULL;
+
+    done = PyObject_IsTrue(res);
+    Py_DECREF(res);
+
+    if (done < 0)
+        return NULL;
+
+    if (!done) {
+        res = PyObject_CallMethod(future, "set_result", "i", sts);
+
+        if (res == NULL)
+            return NULL;
+
+        Py_DECREF(res);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef spam_system_async_done_def = {
+    "_system_async_done", spam_system_async_done, METH_NOARGS, NULL
+};
+
+/* The future is done; if the command is still running, the future was cancelled (or its result set by someone else) and the command is killed */
+
+static PyObject *
+
+spam_system_async_cancelled(PyObject *state, PyObject *Py_UNUSED(future))
+{
+    PyObject *loop = PyTuple_GET_ITEM(state, 0);
+    SpamChild *child = PyCapsule_GetPointer(PyTuple_GET_ITEM(state, 1), SPAM_ASYNC_CHILD);
+    PyObject *res;
+
+    if (child == NULL)
+        return NULL;
+
+    if (child->pid == 0)
+        Py_RETURN_NONE;
+
+    /* The reader must go before its descriptor is closed; a closed loop has no readers left to remove */
+
+    res = PyObject_CallMethod(loop, "remove_reader", "i", child->pidfd);
+
+    spam_async_child_release(child);
+
+    if (res == NULL)
+        return NULL;
+
+    Py_DECREF(res);
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef spam_system_async_cancelled_def = {
+    "_system_async_cancelled", spam_system_async_cancelled, METH_O, NULL
+};
+
+/*[fastcall input]
+spam.system_async
+
+    command: str
+    /
+
+Execute a shell command and return an asyncio future for its status.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_system_async__doc__,
+"system_async(command, /)\n"
+"--\n"
+"\n"
+"Execute a shell command and return an asyncio future for its status.");
+
+#define SPAM_SYSTEM_ASYNC_METHODDEF    \
+    {"system_async", (PyCFunction)(void(*)(void))spam_system_async, METH_FASTCALL, spam_system_async__doc__},
+
+static PyObject *
+spam_system_async_impl(PyObject *module, const char *command);
+
+static PyObject *
+spam_system_async(PyObject *module, PyObject *const *args, Py_ssize_t nargs)
+{
+    PyObject *return_value = NULL;
+    PyObject *argsbuf[1] = {NULL};
+    const char *command;
+    Py_ssize_t i;
+
+    if (nargs != 1) {
+        PyErr_Format(PyExc_TypeError, "system_async() takes exactly 1 argument (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    if (_fastcall_str("system_async", "command", argsbuf[0], &command) < 0)
+        goto exit;
+
+    return_value = spam_system_async_impl(module, command);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "system_async() missing required argument '%s' (pos %zd)",
+                 (const char *[]){"command"}[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_system_async_impl(PyObject *module, const char *command)
+{
+    static char *shell_argv[] = {"/bin/sh", "-c", NULL, NULL};
+    PyObject *asyncio, *loop, *capsule, *future = NULL, *state = NULL, *callback = NULL;
+    PyObject *done_state = NULL, *done_callback = NULL, *res = NULL;
+    posix_spawnattr_t attr;
+    char *argv[4];
+    SpamChild *child;
+    int err;
+
+    asyncio = PyImport_ImportModule("asyncio");
+
+    if (asyncio == NULL)
+        return NULL;
+
+    loop = PyObject_CallMethod(asyncio, "get_running_loop", NULL);
+    Py_DECREF(asyncio);
+
+    if (loop == NULL)
+        return NULL;
+
+    memcpy(argv, shell_argv, sizeof(shell_argv));
+    argv[2] = (char *) command;
+
+    if ((child = PyMem_Malloc(sizeof(SpamChild))) == NULL) {
+        Py_DECREF(loop);
+
+        return PyErr_NoMemory();
+    }
+
+    spam_spawnattr_init(&attr);
+
+    if ((err = spam_child_spawn(child, argv, NULL, &attr)) == 0) {
+        spam_child_watch(child);
+        err = (child->pidfd < 0) ? errno : 0;
+    }
+
+    posix_spawnattr_destroy(&attr);
+
+    capsule = (err == 0) ? PyCapsule_New(child, SPAM_ASYNC_CHILD, spam_async_child_free) : NULL;
+
+    if (capsule == NULL) {
+        if (err != 0) {
+            errno = err;
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, argv[0]);
+        }
+
+        spam_async_child_release(child);
+        PyMem_Free(child);
+        Py_DECREF(loop);
+
+        return NULL;
+    }
+
+    /* From here on, dropping the capsule kills and reaps the child */
+
+    future = PyObject_CallMethod(loop, "create_future", NULL);
+
+    if (future != NULL) {
+        state = PyTuple_Pack(3, loop, future, capsule);
+        done_state = PyTuple_Pack(2, loop, capsule);
+    }
+
+    if (state != NULL && done_state != NULL) {
+        callback = PyCFunction_New(&spam_system_async_done_def, state);
+        done_callback = PyCFunction_New(&spam_system_async_cancelled_def, done_state);
+    }
+
+    if (callback != NULL && done_callback != NULL)
+        res = PyObject_CallMethod(future, "add_done_callback", "O", done_callback);
+
+    if (res != NULL) {
+        Py_DECREF(res);
+        res = PyObject_CallMethod(loop, "add_reader", "iO", child->pidfd, callback);
+    }
+
+    if (res == NULL)
+        Py_CLEAR(future);
+    else
+        Py_DECREF(res);
+
+    Py_XDECREF(callback);
+    Py_XDECREF(done_callback);
+    Py_XDECREF(state);
+    Py_XDECREF(done_state);
+    Py_DECREF(capsule);
+    Py_DECREF(loop);
+
+    return future;
+}
+
+/*
+ Capturing the output of a pipeline:
+ spam.system() can only report an exit status.
+ spam.pipeline([argv1, argv2, ...], capture=True) starts every stage with posix_spawn() and connects the stages to each other with pipes, so the data
+ flowing between them is moved by the kernel and never passes through this process at all.
+ With capture=True the standard output of the last stage is read straight into the storage of a bytes object, which grows geometrically and is trimmed
+ once at the end; memoryview() over the result does not copy it again.
+ The call returns a tuple (output, statuses), where output is None when capture is false.
+ spam.pipeline_lines(stages) starts the same pipeline but returns an iterator over the lines of its output instead, for consumers that want to stream;
+ its statuses attribute is filled in once the iterator is exhausted.
+ While the output is read, every stage is also watched through a pidfd and reaped as soon as it exits, so its wall-clock time does not include the time
+ the consumer takes; a stage that exits while the iterator is not being advanced is only noticed at the next read, though.
+ Stages may be strings (run through /bin/sh -c) or argv sequences, exactly as in spam.run_batch().
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+
+typedef struct {
+    Py_ssize_t n;
+    SpamChild *children;
+    int *statuses;           /* filled in as the stages are reaped */
+    struct pollfd *fds;      /* n + 1 entries, for spam_children_reap() */
+    int out;                 /* read end of the last stage's stdout, or -1 */
+} SpamPipeline;
+
+/*
+ All pipes are created with O_CLOEXEC; the dup2() file actions clear that flag on the child's stdin and stdout only, so no child inherits the other
+ pipe ends and every reader sees end-of-file as soon as its writer exits.
+ If a pipe cannot be created, the stages already started are killed and reaped, and the errno is returned; a stage without its pipe would write to
+ our own stdout instead.
+*/
+
+static int
+
+spam_pipeline_spawn(char ***argvs, SpamPipeline *p, int capture)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int in = -1, fds[2], err;
+    Py_ssize_t i, j;
+
+    p->out = -1;
+
+    spam_spawnattr_init(&attr);
+
+    for (i = 0; i < p->n; i++) {
+        int out = -1;
+
+        fds[0] = fds[1] = -1;
+
+        if (i < p->n - 1 || capture) {
+            if (pipe2(fds, O_CLOEXEC) < 0) {
+                err = errno;
+
+                if (in >= 0)
+                    close(in);
+
+                for (j = 0; j < i; j++) {
+                    if (p->children[j].pid > 0)
+                        kill(p->children[j].pid, SIGKILL);
+
+                    spam_child_wait(&p->children[j], 0);
+                }
+
+                posix_spawnattr_destroy(&attr);
+
+                return err;
+            }
+
+            out = fds[1];
+        }
+
+        posix_spawn_file_actions_init(&actions);
+
+        if (in >= 0)
+            posix_spawn_file_actions_adddup2(&actions, in, 0);
+
+        if (out >= 0)
+            posix_spawn_file_actions_adddup2(&actions, out, 1);
+
+        spam_child_spawn(&p->children[i], argvs[i], &actions, &attr);
+        p->children[i].index = i;
+        spam_child_watch(&p->children[i]);
+
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (in >= 0)
+            close(in);
+
+        if (out >= 0)
+            close(out);
+
+        in = fds[0];
+    }
+
+    posix_spawnattr_destroy(&attr);
+
+    if (capture)
+        p->out = in;
+    else if (in >= 0)
+        close(in);
+
+    return 0;
+}
+
+/* Convert the stages and start them; returns -1 with an exception set on failure */
+
+static int
+
+spam_pipeline_start(PyObject *stages, int capture, SpamPipeline *p)
+{
+    PyObject *keep;
+    char ***argvs;
+    Py_ssize_t i, n;
+    int rc = -1, err;
+
+    stages = PySequence_Tuple(stages);
+
+    if (stages == NULL)
+        return -1;
+
+    n = PyTuple_GET_SIZE(stages);
+
+    if (n == 0) {
+        PyErr_SetString(PyExc_ValueError, "a pipeline needs at least one stage");
+        Py_DECREF(stages);
+
+        return -1;
+    }
+
+    keep = PyTuple_New(n);
+    argvs = PyMem_New(char **, n);
+    p->children = PyMem_New(SpamChild, n);
+    p->statuses = PyMem_New(int, n);
+    p->fds = PyMem_New(struct pollfd, n + 1);
+    p->n = 0;
+
+    if (keep == NULL || argvs == NULL || p->children == NULL || p->statuses == NULL || p->fds == NULL) {
+        if (keep != NULL)
+            PyErr_NoMemory();
+
+        goto done;
+    }
+
+    for (i = 0; i < n; i++) {
+        PyObject *owner = NULL;
+
+        argvs[i] = spam_batch_argv(PyTuple_GET_ITEM(stages, i), &owner);
+
+        if (owner != NULL)
+            PyTuple_SET_ITEM(keep, i, owner);
+
+        if (argvs[i] == NULL) {
+            p->n = i;
+            goto done;
+        }
+    }
+
+    p->n = n;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = spam_pipeline_spawn(argvs, p, capture);
+    Py_END_ALLOW_THREADS
+
+    if (err != 0) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_OSError);
+
+        goto done;
+    }
+
+    rc = 0;
+
+done:
+    if (argvs != NULL) {
+        for (i = 0; i < p->n; i++)
+            PyMem_Free(argvs[i]);
+    }
+
+    PyMem_Free(argvs);
+
+    if (rc < 0) {
+        PyMem_Free(p->children);
+        PyMem_Free(p->statuses);
+        PyMem_Free(p->fds);
+        p->children = NULL;
+    }
+
+    Py_XDECREF(keep);
+    Py_DECREF(stages);
+
+    return rc;
+}
+
+/*
+ Close the output, reap every stage and return their statuses as a list.
+ With stop set, for a consumer that gives up on the output, the stages still running are sent SIGTERM first: a stage that is not writing, or only
+ writes to a stage that is not reading, would otherwise never notice that the pipe is closed.
+*/
+
+static PyObject *
+
+spam_pipeline_finish(SpamPipeline *p, int stop)
+{
+    PyObject *statuses;
+    Py_ssize_t i;
+    int ready;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    if (p->out >= 0)
+        close(p->out);
+
+    for (i = 0; stop && i < p->n; i++) {
+        if (p->children[i].pid > 0)
+            kill(p->children[i].pid, SIGTERM);
+    }
+
+    while (spam_children_reap(p->children, p->n, p->fds, -1, &ready, p->statuses) != 0)
+        ;
+
+    Py_END_ALLOW_THREADS
+
+    p->out = -1;
+    PyMem_Free(p->children);
+    PyMem_Free(p->fds);
+    p->children = NULL;
+
+    statuses = PyList_New(p->n);
+
+    for (i = 0; statuses != NULL && i < p->n; i++) {
+        PyObject *item = PyLong_FromLong(p->statuses[i]);
+
+        if (item == NULL)
+            Py_CLEAR(statuses);
+        else
+            PyList_SET_ITEM(statuses, i, item);
+    }
+
+    PyMem_Free(p->statuses);
+
+    return statuses;
+}
+
+/*
+ read() from the last stage with the GIL released, reaping the stages that exit meanwhile; returns the byte count, 0 at end-of-file, -1 with an
+ exception set
+*/
+
+static Py_ssize_t
+
+spam_pipeline_read(SpamPipeline *p, char *buf, Py_ssize_t size)
+{
+    Py_ssize_t r;
+    int ready = 0;
+
+    for (;;) {
+        Py_BEGIN_ALLOW_THREADS
+
+        do {
+            r = spam_children_reap(p->children, p->n, p->fds, p->out, &ready, p->statuses);
+        } while (r > 0 && !ready);
+
+        if (r >= 0)
+            r = read(p->out, buf, size);
+
+        Py_END_ALLOW_THREADS
+
+        if (r >= 0)
+            return r;
+
+        if (errno != EINTR || PyErr_CheckSignals() < 0)
+            break;
+    }
+
+    if (!PyErr_Occurred())
+        PyErr_SetFromErrno(PyExc_OSError);
+
+    return -1;
+}
+
+#define SPAM_PIPELINE_CHUNK 65536
+
+/*[fastcall input]
+spam.pipeline
+
+    stages: object
+    capture: bool = 1
+
+Run connected commands and return their captured output and statuses.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_pipeline__doc__,
+"pipeline(stages, capture=True)\n"
+"--\n"
+"\n"
+"Run connected commands and return their captured output and statuses.");
+
+#define SPAM_PIPELINE_METHODDEF    \
+    {"pipeline", (PyCFunction)(void(*)(void))spam_pipeline, METH_FASTCALL | METH_KEYWORDS, spam_pipeline__doc__},
+
+static PyObject *
+spam_pipeline_impl(PyObject *module, PyObject *stages, int capture);
+
+static PyObject *
+spam_pipeline(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *return_value = NULL;
+    static const char * const _keywords[] = {"stages", "capture"};
+    static PyObject *_interned[2];
+    PyObject *argsbuf[2] = {NULL, NULL};
+    PyObject *stages;
+    int capture = 1;
+    Py_ssize_t i;
+
+    if (nargs > 2) {
+        PyErr_Format(PyExc_TypeError, "pipeline() takes at most 2 arguments (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    if (kwnames != NULL) {
+        if (_fastcall_intern(_interned, _keywords, 2) < 0)
+            goto exit;
+
+        if (_fastcall_match("pipeline", args, nargs, kwnames, _interned, 0, 2, argsbuf) < 0)
+            goto exit;
+    }
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    stages = argsbuf[0];
+
+    if (argsbuf[1] != NULL) {
+        capture = PyObject_IsTrue(argsbuf[1]);
+        if (capture < 0)
+            goto exit;
+    }
+
+    return_value = spam_pipeline_impl(module, stages, capture);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "pipeline() missing required argument '%s' (pos %zd)",
+                 _keywords[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_pipeline_impl(PyObject *module, PyObject *stages, int capture)
+{
+    PyObject *output = NULL, *statuses;
+    Py_ssize_t len = 0, cap = SPAM_PIPELINE_CHUNK, r;
+    SpamPipeline p;
+
+    if (spam_pipeline_start(stages, capture, &p) < 0)
+        return NULL;
+
+    if (capture && p.out >= 0) {
+        output = PyBytes_FromStringAndSize(NULL, cap);
+
+        while (output != NULL) {
+            if (len == cap && _PyBytes_Resize(&output, cap *= 2) < 0)
+                break;
+
+            r = spam_pipeline_read(&p, PyBytes_AS_STRING(output) + len, cap - len);
+
+            if (r < 0) {
+                Py_CLEAR(output);
+                break;
+            }
+
+            if (r == 0)
+                break;
+
+            len += r;
+        }
+
+        if (output != NULL && _PyBytes_Resize(&output, len) < 0)
+            output = NULL;
+    }
+    else if (capture) {
+        output = PyBytes_FromStringAndSize(NULL, 0);
+    }
+
+    /* The children must be reaped even if reading failed */
+
+    if (output == NULL && capture) {
+        PyObject *type, *value, *tb;
+
+        PyErr_Fetch(&type, &value, &tb);
+        Py_XDECREF(spam_pipeline_finish(&p, 1));
+        PyErr_Restore(type, value, tb);
+
+        return NULL;
+    }
+
+    statuses = spam_pipeline_finish(&p, 0);
+
+    if (statuses == NULL) {
+        Py_XDECREF(output);
+
+        return NULL;
+    }
+
+    if (output == NULL) {
+        Py_INCREF(Py_None);
+        output = Py_None;
+    }
+
+    return Py_BuildValue("NN", output, statuses);
+}
+
+/*
+ The line iterator keeps the read end of the pipeline open and refills a private buffer with one read() at a time, so memory use is bounded by the
+ longest line rather than by the whole output.
+*/
+
+typedef struct {
+    PyObject_HEAD
+    SpamPipeline p;
+    char *buf;
+    Py_ssize_t start, end, cap;
+    PyObject *statuses;
+} SpamPipelineLinesObject;
+
+static void
+
+SpamPipelineLines_dealloc(SpamPipelineLinesObject *self)
+{
+    /* The iterator was dropped before the end of the output, so nobody wants the rest of it */
+
+    if (self->p.children != NULL)
+        Py_XDECREF(spam_pipeline_finish(&self->p, 1));
+
+    PyMem_Free(self->buf);
+    Py_XDECREF(self->statuses);
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *
+
+SpamPipelineLines_next(SpamPipelineLinesObject *self)
+{
+    PyObject *line;
+    char *nl;
+    Py_ssize_t r;
+
+    if (self->p.children == NULL)
+        return NULL;
+
+    for (;;) {
+        nl = memchr(self->buf + self->start, '\n', self->end - self->start);
+
+        if (nl != NULL) {
+            line = PyBytes_FromStringAndSize(self->buf + self->start,
+                                             nl + 1 - (self->buf + self->start));
+            self->start = nl + 1 - self->buf;
+
+            return line;
+        }
+
+        /* Move the partial line to the front, and grow only if it fills the buffer */
+
+        if (self->start > 0) {
+            memmove(self->buf, self->buf + self->start, self->end - self->start);
+            self->end -= self->start;
+            self->start = 0;
+        }
+
+        if (self->end == self->cap) {
+            char *buf = PyMem_Realloc(self->buf, self->cap * 2);
+
+            if (buf == NULL)
+                return PyErr_NoMemory();
+
+            self->buf = buf;
+            self->cap *= 2;
+        }
+
+        r = spam_pipeline_read(&self->p, self->buf + self->end, self->cap - self->end);
+
+        if (r < 0)
+            return NULL;
+
+        if (r == 0)
+            break;
+
+        self->end += r;
+    }
+
+    self->statuses = spam_pipeline_finish(&self->p, 0);
+
+    if (self->statuses == NULL || self->end == 0)
+        return NULL;
+
+    line = PyBytes_FromStringAndSize(self->buf, self->end);
+    self->start = self->end = 0;
+
+    return line;
+}
+
+static PyObject *
+
+SpamPipelineLines_getstatuses(SpamPipelineLinesObject *self, void *closure)
+{
+    PyObject *statuses = self->statuses ? self->statuses : Py_None;
+
+    Py_INCREF(statuses);
+
+    return statuses;
+}
+
+static PyGetSetDef SpamPipelineLines_getsetters[] = {
+    {"statuses", (getter) SpamPipelineLines_getstatuses, NULL,
+     "exit statuses of the stages, or None while the pipeline is running", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject SpamPipelineLinesType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "spam.PipelineLines",
+    .tp_doc = "Iterator over the output lines of a pipeline",
+    .tp_basicsize = sizeof(SpamPipelineLinesObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) SpamPipelineLines_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc) SpamPipelineLines_next,
+    .tp_getset = SpamPipelineLines_getsetters,
+};
+
+/*[fastcall input]
+spam.pipeline_lines
+
+    stages: object
+    /
+
+Run connected commands and iterate over the lines of their output.
+[fastcall start generated code]*/
+PyDoc_STRVAR(spam_pipeline_lines__doc__,
+"pipeline_lines(stages, /)\n"
+"--\n"
+"\n"
+"Run connected commands and iterate over the lines of their output.");
+
+#define SPAM_PIPELINE_LINES_METHODDEF    \
+    {"pipeline_lines", (PyCFunction)(void(*)(void))spam_pipeline_lines, METH_FASTCALL, spam_pipeline_lines__doc__},
+
+static PyObject *
+spam_pipeline_lines_impl(PyObject *module, PyObject *stages);
+
+static PyObject *
+spam_pipeline_lines(PyObject *module, PyObject *const *args, Py_ssize_t nargs)
+{
+    PyObject *return_value = NULL;
+    PyObject *argsbuf[1] = {NULL};
+    PyObject *stages;
+    Py_ssize_t i;
+
+    if (nargs != 1) {
+        PyErr_Format(PyExc_TypeError, "pipeline_lines() takes exactly 1 argument (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    stages = argsbuf[0];
+
+    return_value = spam_pipeline_lines_impl(module, stages);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "pipeline_lines() missing required argument '%s' (pos %zd)",
+                 (const char *[]){"stages"}[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+spam_pipeline_lines_impl(PyObject *module, PyObject *stages)
+{
+    SpamPipelineLinesObject *it;
+
+    it = PyObject_New(SpamPipelineLinesObject, &SpamPipelineLinesType);
+
+    if (it == NULL)
+        return NULL;
+
+    it->p.children = NULL;
+    it->statuses = NULL;
+    it->start = it->end = 0;
+    it->cap = SPAM_PIPELINE_CHUNK;
+    it->buf = PyMem_Malloc(it->cap);
+
+    if (it->buf == NULL) {
+        Py_DECREF(it);
+
+        return PyErr_NoMemory();
+    }
+
+    if (spam_pipeline_start(stages, 1, &it->p) < 0) {
+        Py_DECREF(it);
+
+        return NULL;
+    }
+
+    return (PyObject *) it;
+}
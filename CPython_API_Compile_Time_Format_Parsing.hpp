@@ -0,0 +1,541 @@
+/*
+ CPython API
+ To support extensions, the Python API (Application Programmers Interface) defines a set of functions, macros and variables that provide access to most
+ aspects of the Python run-time system.
+ The Python API is incorporated in a C source file by including the header "Python.h".
+ The compilation of an extension module depends on its intended use as well as on your system setup.
+
+ Note:
+ The C extension interface is specific to CPython, and extension modules do not work on other Python implementations.
+ In many cases, it is possible to avoid writing C extensions and preserve portability to other implementations.
+ For example, if your use case is calling C library functions or system calls, you should consider using the ctypes module or the cffi library rather than
+ writing custom C code.
+ These modules let you write Python code to interface with C code and are more portable between implementations of Python than writing and compiling a C
+ extension module.
+
+*/
+
+/*
+ Parsing format strings at compile time:
+ PyArg_ParseTuple() interprets its format string one character at a time on every call, and it cannot check that the addresses passed after the format
+ have the types the format asks for; a mistake there overwrites random memory.
+ Extensions written in C++ can do better with this header-only template layer.
+ The format string is a template argument, so it is parsed by the compiler:
+
+    pyargs::parse<"(ii)s#">(args, nargs, &i, &j, &s, &size)
+
+ rejects unknown format units, checks every destination pointer against the unit it belongs to (a long * passed for "i" does not compile), and expands
+ into a straight-line sequence of conversions over the argument vector of a METH_FASTCALL function.
+ pyargs::parse_tuple<"...">(args, ...) does the same for the argument tuple of a METH_VARARGS function, so existing code can switch over one call at a
+ time without changing the signature of the function.
+ The syntax is the one of PyArg_ParseTuple(), restricted to the units below; like PyArg_ParseTuple(), both functions return true on success and false
+ with an exception set on failure.
+
+    i  int              l  long              L  long long          n  Py_ssize_t
+    d  double           D  Py_complex        p  int (truth value)
+    s  const char *     s# const char *, Py_ssize_t                z  const char * (None gives NULL)
+    y  const char * (from bytes)             U  PyObject * (str)   S  PyObject * (bytes)
+    O  PyObject *       (...)  nested sequence                     |  rest is optional
+    :name  function name for error messages  ;text  replaces the whole error message
+
+ This requires C++20, for string literals as template arguments.
+*/
+
+#ifndef PYARGS_COMPILE_TIME_FORMAT_HPP
+#define PYARGS_COMPILE_TIME_FORMAT_HPP
+
+#include <Python.h>
+
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+
+namespace pyargs {
+
+/* A string literal usable as a template argument */
+
+template <std::size_t N>
+struct fixed_string {
+    char s[N];
+
+    consteval fixed_string(const char (&str)[N])
+    {
+        for (std::size_t i = 0; i < N; i++)
+            s[i] = str[i];
+    }
+};
+
+namespace detail {
+
+/* Compile-time analysis of the format; a throw inside a consteval function is a compile error */
+
+consteval bool is_end(char c)
+{
+    return c == '\0' || c == ':' || c == ';';
+}
+
+consteval bool is_unit(char c)
+{
+    for (const char *u = "ilLndDpszyUSO"; *u != '\0'; u++) {
+        if (*u == c)
+            return true;
+    }
+
+    return false;
+}
+
+/* Position just after the item (unit or group) starting at pos */
+
+template <std::size_t N>
+consteval std::size_t skip_item(const fixed_string<N> &f, std::size_t pos)
+{
+    if (f.s[pos] == '(') {
+        pos++;
+
+        while (f.s[pos] != ')') {
+            if (is_end(f.s[pos]) || f.s[pos] == '|')
+                throw "unterminated or optional group in format";
+
+            pos = skip_item(f, pos);
+        }
+
+        return pos + 1;
+    }
+
+    if (!is_unit(f.s[pos]))
+        throw "unsupported format unit";
+
+    if (f.s[pos + 1] == '#') {
+        if (f.s[pos] != 's')
+            throw "'#' is only supported after 's'";
+
+        return pos + 2;
+    }
+
+    return pos + 1;
+}
+
+/* Number of items in the sequence starting at pos, and how many of them are required */
+
+template <std::size_t N>
+consteval std::size_t count_items(const fixed_string<N> &f, std::size_t pos, bool required_only)
+{
+    std::size_t n = 0;
+
+    while (!is_end(f.s[pos]) && f.s[pos] != ')') {
+        if (f.s[pos] == '|') {
+            if (required_only)
+                break;
+
+            pos++;
+            continue;
+        }
+
+        pos = skip_item(f, pos);
+        n++;
+    }
+
+    return n;
+}
+
+template <std::size_t N>
+consteval bool validate(const fixed_string<N> &f)
+{
+    std::size_t pos = 0;
+    bool optional = false;
+
+    while (!is_end(f.s[pos])) {
+        if (f.s[pos] == '|') {
+            if (optional)
+                throw "'|' given twice in format";
+
+            optional = true;
+            pos++;
+        }
+        else if (f.s[pos] == ')') {
+            throw "unmatched ')' in format";
+        }
+        else {
+            pos = skip_item(f, pos);
+        }
+    }
+
+    return true;
+}
+
+/* Where the ':name' or ';message' tail of the format starts */
+
+template <std::size_t N>
+consteval std::size_t tail_pos(const fixed_string<N> &f)
+{
+    std::size_t pos = 0;
+
+    while (!is_end(f.s[pos]))
+        pos++;
+
+    return pos;
+}
+
+template <fixed_string F>
+inline const char *fname()
+{
+    constexpr std::size_t pos = tail_pos(F);
+
+    if constexpr (F.s[pos] == ':')
+        return F.s + pos + 1;
+    else
+        return "function";
+}
+
+template <fixed_string F>
+inline const char *custom_message()
+{
+    constexpr std::size_t pos = tail_pos(F);
+
+    if constexpr (F.s[pos] == ';')
+        return F.s + pos + 1;
+    else
+        return nullptr;
+}
+
+/* The destination pointer types the format asks for, as a std::tuple */
+
+template <char C> struct dest;
+template <> struct dest<'i'> { using type = std::tuple<int *>; };
+template <> struct dest<'l'> { using type = std::tuple<long *>; };
+template <> struct dest<'L'> { using type = std::tuple<long long *>; };
+template <> struct dest<'n'> { using type = std::tuple<Py_ssize_t *>; };
+template <> struct dest<'d'> { using type = std::tuple<double *>; };
+template <> struct dest<'D'> { using type = std::tuple<Py_complex *>; };
+template <> struct dest<'p'> { using type = std::tuple<int *>; };
+template <> struct dest<'s'> { using type = std::tuple<const char **>; };
+template <> struct dest<'#'> { using type = std::tuple<const char **, Py_ssize_t *>; };
+template <> struct dest<'z'> { using type = std::tuple<const char **>; };
+template <> struct dest<'y'> { using type = std::tuple<const char **>; };
+template <> struct dest<'U'> { using type = std::tuple<PyObject **>; };
+template <> struct dest<'S'> { using type = std::tuple<PyObject **>; };
+template <> struct dest<'O'> { using type = std::tuple<PyObject **>; };
+
+template <fixed_string F, std::size_t Pos>
+auto dest_types()
+{
+    constexpr char c = F.s[Pos];
+
+    if constexpr (is_end(c)) {
+        return std::tuple<>{};
+    }
+    else if constexpr (c == '(' || c == ')' || c == '|') {
+        return dest_types<F, Pos + 1>();
+    }
+    else if constexpr (F.s[Pos + 1] == '#') {
+        return std::tuple_cat(typename dest<'#'>::type{}, dest_types<F, Pos + 2>());
+    }
+    else {
+        return std::tuple_cat(typename dest<c>::type{}, dest_types<F, Pos + 1>());
+    }
+}
+
+template <fixed_string F>
+using dest_tuple = decltype(dest_types<F, 0>());
+
+/* Number of destinations used by the items between Pos and End */
+
+template <fixed_string F, std::size_t Pos, std::size_t End>
+consteval std::size_t dests_between()
+{
+    std::size_t n = 0;
+
+    for (std::size_t pos = Pos; pos < End; pos++) {
+        if (is_unit(F.s[pos]))
+            n++;
+        else if (F.s[pos] == '#')
+            n++;
+    }
+
+    return n;
+}
+
+/* Error reporting in the style of PyArg_ParseTuple() */
+
+template <fixed_string F>
+bool type_error(const char *expected, PyObject *arg)
+{
+    const char *message = custom_message<F>();
+
+    if (message != nullptr)
+        PyErr_SetString(PyExc_TypeError, message);
+    else
+        PyErr_Format(PyExc_TypeError, "%.200s() argument must be %.50s, not %.50s",
+                     fname<F>(), expected, arg == Py_None ? "None" : Py_TYPE(arg)->tp_name);
+
+    return false;
+}
+
+template <typename T>
+bool as_integer(PyObject *arg, T *out)
+{
+    if (sizeof(T) <= sizeof(long)) {
+        long value = PyLong_AsLong(arg);
+
+        if (value == -1 && PyErr_Occurred())
+            return false;
+
+        if (value < (long) std::numeric_limits<T>::min() || value > (long) std::numeric_limits<T>::max()) {
+            PyErr_SetString(PyExc_OverflowError,
+                            "signed integer is out of range for the C type");
+
+            return false;
+        }
+
+        *out = (T) value;
+    }
+    else {
+        long long value = PyLong_AsLongLong(arg);
+
+        if (value == -1 && PyErr_Occurred())
+            return false;
+
+        *out = (T) value;
+    }
+
+    return true;
+}
+
+template <fixed_string F>
+bool as_utf8(PyObject *arg, const char **out, Py_ssize_t *size)
+{
+    Py_ssize_t len;
+
+    if (!PyUnicode_Check(arg))
+        return type_error<F>("str", arg);
+
+    *out = PyUnicode_AsUTF8AndSize(arg, &len);
+
+    if (*out == nullptr)
+        return false;
+
+    if (size != nullptr) {
+        *size = len;
+    }
+    else if ((Py_ssize_t) std::strlen(*out) != len) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+
+        return false;
+    }
+
+    return true;
+}
+
+/* One conversion per format unit; each is instantiated only for the units a format actually uses */
+
+template <fixed_string F, char C, bool Hash, typename Tuple, std::size_t Dst>
+bool convert(PyObject *arg, Tuple &dst)
+{
+    auto *out = std::get<Dst>(dst);
+
+    if constexpr (C == 'i' || C == 'l' || C == 'L' || C == 'n') {
+        if (PyFloat_Check(arg))
+            return type_error<F>("int", arg);
+
+        if constexpr (C == 'n') {
+            *out = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+            return !(*out == -1 && PyErr_Occurred());
+        }
+        else {
+            return as_integer(arg, out);
+        }
+    }
+    else if constexpr (C == 'd') {
+        *out = PyFloat_AsDouble(arg);
+
+        return !(*out == -1.0 && PyErr_Occurred());
+    }
+    else if constexpr (C == 'D') {
+        *out = PyComplex_AsCComplex(arg);
+
+        return !(out->real == -1.0 && PyErr_Occurred());
+    }
+    else if constexpr (C == 'p') {
+        *out = PyObject_IsTrue(arg);
+
+        return *out >= 0;
+    }
+    else if constexpr (C == 's' && Hash) {
+        return as_utf8<F>(arg, out, std::get<Dst + 1>(dst));
+    }
+    else if constexpr (C == 's') {
+        return as_utf8<F>(arg, out, nullptr);
+    }
+    else if constexpr (C == 'z') {
+        if (arg == Py_None) {
+            *out = nullptr;
+
+            return true;
+        }
+
+        return as_utf8<F>(arg, out, nullptr);
+    }
+    else if constexpr (C == 'y') {
+        if (!PyBytes_Check(arg))
+            return type_error<F>("bytes", arg);
+
+        *out = PyBytes_AS_STRING(arg);
+
+        if ((Py_ssize_t) std::strlen(*out) != PyBytes_GET_SIZE(arg)) {
+            PyErr_SetString(PyExc_ValueError, "embedded null byte");
+
+            return false;
+        }
+
+        return true;
+    }
+    else if constexpr (C == 'U' || C == 'S') {
+        if (C == 'U' ? !PyUnicode_Check(arg) : !PyBytes_Check(arg))
+            return type_error<F>(C == 'U' ? "str" : "bytes", arg);
+
+        *out = arg;
+
+        return true;
+    }
+    else {
+        static_assert(C == 'O');
+
+        *out = arg;
+
+        return true;
+    }
+}
+
+/*
+ The unpacker: one instantiation per item of the format, each of which converts its item and tail-calls the next one.
+ The item counts are checked up front, so the only run-time test per item is whether an optional argument was given.
+*/
+
+template <fixed_string F, std::size_t Pos, std::size_t Dst, typename Tuple>
+bool unpack(PyObject *const *items, Py_ssize_t n, Py_ssize_t idx, Tuple &dst)
+{
+    constexpr char c = F.s[Pos];
+
+    if constexpr (is_end(c) || c == ')') {
+        return true;
+    }
+    else if constexpr (c == '|') {
+        return unpack<F, Pos + 1, Dst>(items, n, idx, dst);
+    }
+    else if constexpr (c == '(') {
+        constexpr std::size_t end = skip_item(F, Pos);
+        constexpr std::size_t count = count_items(F, Pos + 1, false);
+        PyObject *seq;
+        bool ok;
+
+        if (idx >= n)
+            return true;
+
+        if (!PySequence_Check(items[idx]) || PyUnicode_Check(items[idx]) || PyBytes_Check(items[idx]))
+            return type_error<F>("a sequence", items[idx]);
+
+        seq = PySequence_Fast(items[idx], "expected a sequence");
+
+        if (seq == nullptr)
+            return false;
+
+        if (PySequence_Fast_GET_SIZE(seq) != (Py_ssize_t) count) {
+            PyErr_Format(PyExc_TypeError, "%.200s() argument must be sequence of length %zu, not %zd",
+                         fname<F>(), count, PySequence_Fast_GET_SIZE(seq));
+            Py_DECREF(seq);
+
+            return false;
+        }
+
+        /* Like PyArg_ParseTuple(), borrowed results point into the original sequence */
+
+        ok = unpack<F, Pos + 1, Dst>(PySequence_Fast_ITEMS(seq), count, 0, dst);
+        Py_DECREF(seq);
+
+        return ok && unpack<F, end, Dst + dests_between<F, Pos, end>()>(items, n, idx + 1, dst);
+    }
+    else {
+        constexpr bool hash = F.s[Pos + 1] == '#';
+
+        if (idx >= n)
+            return true;
+
+        if (!convert<F, c, hash, Tuple, Dst>(items[idx], dst))
+            return false;
+
+        return unpack<F, Pos + 1 + hash, Dst + 1 + hash>(items, n, idx + 1, dst);
+    }
+}
+
+}  // namespace detail
+
+/* Parse the argument vector of a METH_FASTCALL function */
+
+template <fixed_string F, typename... Dest>
+bool parse(PyObject *const *args, Py_ssize_t nargs, Dest... dest)
+{
+    static_assert(detail::validate(F));
+    static_assert(std::is_same_v<std::tuple<Dest...>, detail::dest_tuple<F>>,
+                  "destination pointers do not match the format string");
+
+    constexpr Py_ssize_t min = detail::count_items(F, 0, true);
+    constexpr Py_ssize_t max = detail::count_items(F, 0, false);
+    std::tuple<Dest...> dst(dest...);
+
+    if (nargs < min || nargs > max) {
+        const char *message = detail::custom_message<F>();
+
+        if (message != nullptr)
+            PyErr_SetString(PyExc_TypeError, message);
+        else if (min == max)
+            PyErr_Format(PyExc_TypeError, "%.200s() takes exactly %zd argument%s (%zd given)",
+                         detail::fname<F>(), min, min == 1 ? "" : "s", nargs);
+        else
+            PyErr_Format(PyExc_TypeError, "%.200s() takes %s %zd argument%s (%zd given)",
+                         detail::fname<F>(), nargs < min ? "at least" : "at most",
+                         nargs < min ? min : max, (nargs < min ? min : max) == 1 ? "" : "s", nargs);
+
+        return false;
+    }
+
+    return detail::unpack<F, 0, 0>(args, nargs, 0, dst);
+}
+
+/* Parse the argument tuple of a METH_VARARGS function */
+
+template <fixed_string F, typename... Dest>
+bool parse_tuple(PyObject *args, Dest... dest)
+{
+    return parse<F>(&PyTuple_GET_ITEM(args, 0), PyTuple_GET_SIZE(args), dest...);
+}
+
+}  // namespace pyargs
+
+#endif /* !PYARGS_COMPILE_TIME_FORMAT_HPP */
+
+/*
+ The calls from "Extracting Parameters in Extension Functions" look like this with the header; only the name of the function changes, and every one of
+ them is now checked by the compiler:
+
+    ok = pyargs::parse_tuple<"lls">(args, &k, &l, &s);
+    ok = pyargs::parse_tuple<"(ii)s#">(args, &i, &j, &s, &size);
+    ok = pyargs::parse_tuple<"s|si">(args, &file, &mode, &bufsize);
+    ok = pyargs::parse_tuple<"((ii)(ii))(ii)">(args, &left, &top, &right, &bottom, &h, &v);
+    ok = pyargs::parse_tuple<"D:myfunction">(args, &c);
+
+ A METH_FASTCALL function uses the argument vector directly:
+
+    static PyObject *
+    rectangle(PyObject *self, PyObject *const *args, Py_ssize_t nargs)
+    {
+        int left, top, right, bottom, h, v;
+
+        if (!pyargs::parse<"((ii)(ii))(ii):rectangle">(args, nargs, &left, &top, &right, &bottom, &h, &v))
+            return NULL;
+
+        ...
+    }
+*/
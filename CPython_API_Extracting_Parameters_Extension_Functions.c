@@ -104,3 +104,8 @@ ok = PyArg_ParseTuple(args, "(ii)s#", &i, &j, &s, &size);
     /* Possible Python call: myfunction(1+2j) */
 
 }
+
+/*
+ Extensions written in C++ can have these format strings parsed and checked by the compiler instead; see CPython_API_Compile_Time_Format_Parsing.hpp,
+ where the same calls are written as pyargs::parse_tuple<"(ii)s#">(args, &i, &j, &s, &size).
+*/
@@ -0,0 +1,42 @@
+# CPython API
+# Benchmark for the METH_FASTCALL wrappers generated by CPython_API_Fastcall_Clinic.py.
+# It measures the cost of calling keywdarg.parrot() and spam.system()-style functions, positionally and with keywords.
+# The commands themselves would swamp the argument handling, so spam is exercised through spam.run_batch() with an empty batch, which parses its
+# arguments and returns at once, and through spam.set_accounting(), which takes the same single positional argument as spam.system().
+# spam.system(":") itself is timed too, with fewer calls, to show how much of a real call the argument handling is.
+# keywdarg.parrot() writes to the C stdout, which is redirected to /dev/null while it is timed.
+# Run the script once against modules built from the METH_VARARGS sources and once against the generated ones, and compare the ns/call columns.
+#
+
+import os
+import sys
+import timeit
+
+import keywdarg
+import spam
+
+N = 1000000
+
+CALLS = [
+    ("spam.system(\":\")", lambda: spam.system(":"), 2000),
+    ("spam.run_batch((), 1)", lambda: spam.run_batch((), 1), N),
+    ("spam.run_batch((), max_parallel=1)", lambda: spam.run_batch((), max_parallel=1), N),
+    ("spam.set_accounting(False)", lambda: spam.set_accounting(False), N),
+    ("keywdarg.parrot(1)", lambda: keywdarg.parrot(1), N),
+    ("keywdarg.parrot(1, 'a', 'b', 'c')", lambda: keywdarg.parrot(1, 'a', 'b', 'c'), N),
+    ("keywdarg.parrot(voltage=1, type='c')", lambda: keywdarg.parrot(voltage=1, type='c'), N),
+]
+
+sys.stdout.flush()
+saved = os.dup(1)
+devnull = os.open(os.devnull, os.O_WRONLY)
+os.dup2(devnull, 1)
+
+try:
+    results = [(label, min(timeit.repeat(func, number=number, repeat=5)) / number * 1e9)
+               for label, func, number in CALLS]
+finally:
+    os.dup2(saved, 1)
+
+for label, ns in results:
+    print("%-40s %8.1f ns/call" % (label, ns))
@@ -0,0 +1,436 @@
+# CPython API
+# Generating METH_FASTCALL argument parsers.
+# A function registered with METH_VARARGS receives its arguments packed into a tuple, and METH_KEYWORDS adds a dictionary; PyArg_ParseTuple() and
+# PyArg_ParseTupleAndKeywords() then interpret the format string character by character on every call.
+# A function registered with METH_FASTCALL | METH_KEYWORDS receives a plain C array of arguments and a tuple of keyword names instead, so nothing has to
+# be allocated for the call, but the conversion code has to be written by hand.
+# CPython itself solves this with Argument Clinic; this script is a much smaller tool in the same spirit.
+#
+
+#
+# A block like the following is placed in front of the implementation function:
+#
+#   /*[fastcall input]
+#   keywdarg.parrot
+#
+#       voltage: int
+#       state: str = "a stiff"
+#       action: str = "voom"
+#       type: str = "Norwegian Blue"
+#
+#   Print a lovely skit to standard output.
+#   [fastcall start generated code]*/
+#   /*[fastcall end generated code]*/
+#
+# The first line names the function as module.name; the C function is called module_name unless "as c_name" follows.
+# Each indented line declares one parameter with a converter and an optional C default value; a line holding a single "/" makes every parameter above
+# it positional-only, exactly as in a Python signature.
+# The remaining lines are the docstring.
+#
+# Running
+#
+#   python3 CPython_API_Fastcall_Clinic.py file.c [file.c ...]
+#
+# fills in the code between the start and end markers: a prototype for the implementation function module_name_impl(), which receives the converted C
+# values, a wrapper module_name() with the METH_FASTCALL signature, a docstring, and a MODULE_NAME_METHODDEF macro for the method table.
+# The keyword names are interned once, on the first call, so matching a keyword argument is normally a pointer comparison.
+# Each converter is open-coded in the wrapper, so no format string is interpreted at run time.
+# Running the script again regenerates the blocks in place.
+#
+
+import re
+import sys
+
+# converter name: (C type, C code converting the PyObject *arg into the variable, using {arg}, {var}, {fname} and {pname})
+
+CONVERTERS = {
+    'object': ('PyObject *', '{var} = {arg};'),
+    'str': ('const char *', 'if (_fastcall_str("{fname}", "{pname}", {arg}, &{var}) < 0)\n    goto exit;'),
+    'int': ('int', 'if (_fastcall_int("{fname}", "{pname}", {arg}, &{var}) < 0)\n    goto exit;'),
+    'Py_ssize_t': ('Py_ssize_t', 'if (_fastcall_ssize_t("{fname}", "{pname}", {arg}, &{var}) < 0)\n    goto exit;'),
+    'bool': ('int', '{var} = PyObject_IsTrue({arg});\nif ({var} < 0)\n    goto exit;'),
+}
+
+SUPPORT = r'''#ifndef FASTCALL_SUPPORT_DEFINED
+#define FASTCALL_SUPPORT_DEFINED
+
+/* Shared helpers of the generated wrappers; emitted once per translation unit */
+
+static inline int
+_fastcall_intern(PyObject **interned, const char * const *names, Py_ssize_t n)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        if (interned[i] == NULL) {
+            interned[i] = PyUnicode_InternFromString(names[i]);
+
+            if (interned[i] == NULL)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_match(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                PyObject *kwnames, PyObject **interned, Py_ssize_t posonly,
+                Py_ssize_t nparams, PyObject **slots)
+{
+    Py_ssize_t k, i, nkw = PyTuple_GET_SIZE(kwnames);
+
+    for (k = 0; k < nkw; k++) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+
+        /* Keyword names in calls are almost always interned as well */
+
+        for (i = posonly; i < nparams; i++) {
+            if (interned[i] == key)
+                break;
+        }
+
+        if (i == nparams) {
+            for (i = posonly; i < nparams; i++) {
+                if (PyUnicode_Compare(interned[i], key) == 0)
+                    break;
+            }
+        }
+
+        if (i == nparams) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() got an unexpected keyword argument '%S'",
+                         fname, key);
+
+            return -1;
+        }
+
+        if (i < nargs) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for %s() given by name ('%S') and position (%zd)",
+                         fname, key, i + 1);
+
+            return -1;
+        }
+
+        slots[i] = args[nargs + k];
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_str(const char *fname, const char *pname, PyObject *arg, const char **out)
+{
+    Py_ssize_t size;
+
+    if (!PyUnicode_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be str, not %.50s",
+                     fname, pname, Py_TYPE(arg)->tp_name);
+
+        return -1;
+    }
+
+    *out = PyUnicode_AsUTF8AndSize(arg, &size);
+
+    if (*out == NULL)
+        return -1;
+
+    if (strlen(*out) != (size_t) size) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_int(const char *fname, const char *pname, PyObject *arg, int *out)
+{
+    long value;
+
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    value = PyLong_AsLong(arg);
+
+    if (value == -1 && PyErr_Occurred())
+        return -1;
+
+    if (value > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is greater than maximum");
+
+        return -1;
+    }
+
+    if (value < INT_MIN) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is less than minimum");
+
+        return -1;
+    }
+
+    *out = (int) value;
+
+    return 0;
+}
+
+static inline int
+_fastcall_ssize_t(const char *fname, const char *pname, PyObject *arg, Py_ssize_t *out)
+{
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    *out = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (*out == -1 && PyErr_Occurred())
+        return -1;
+
+    return 0;
+}
+
+#endif /* FASTCALL_SUPPORT_DEFINED */
+'''
+
+INPUT = '/*[fastcall input]'
+START = '[fastcall start generated code]*/'
+END = '/*[fastcall end generated code]*/'
+
+
+class Param:
+
+    def __init__(self, line):
+        m = re.match(r'(\w+)\s*:\s*(\w+)\s*(?:=\s*(.+))?$', line)
+
+        if m is None or m.group(2) not in CONVERTERS:
+            raise SyntaxError('bad parameter line: %r' % line)
+
+        self.name, self.converter, self.default = m.groups()
+        self.ctype = CONVERTERS[self.converter][0]
+
+    def signature(self):
+        if self.default is None:
+            return self.name
+
+        default = self.default.replace('"', "'")
+
+        if self.converter == 'bool':
+            default = 'False' if default == '0' else 'True'
+
+        return '%s=%s' % (self.name, default)
+
+
+class Function:
+
+    def __init__(self, text):
+        lines = text.split('\n')
+        m = re.match(r'(\w+)\.(\w+)(?:\s+as\s+(\w+))?$', lines[0].strip())
+
+        if m is None:
+            raise SyntaxError('bad function line: %r' % lines[0])
+
+        self.module, self.name, self.c_name = m.groups()
+        self.c_name = self.c_name or '%s_%s' % (self.module, self.name)
+        self.params = []
+        self.posonly = 0
+        doc = []
+
+        for line in lines[1:]:
+            if line.startswith((' ', '\t')) and not doc:
+                line = line.strip()
+
+                if line == '/':
+                    self.posonly = len(self.params)
+                elif line:
+                    self.params.append(Param(line))
+            elif line.strip() or doc:
+                doc.append(line)
+
+        self.doc = '\n'.join(doc).strip()
+        self.required = len([p for p in self.params if p.default is None])
+
+        if any(p.default is None for p in self.params[self.required:]):
+            raise SyntaxError('%s: required parameter after optional one' % self.name)
+
+    def generate(self):
+        n = len(self.params)
+        fname = self.name
+        out = []
+        emit = out.append
+
+        signature = [p.signature() for p in self.params]
+
+        if self.posonly:
+            signature.insert(self.posonly, '/')
+
+        emit('PyDoc_STRVAR(%s__doc__,' % self.c_name)
+        emit('"%s(%s)\\n"' % (self.name, ', '.join(signature)))
+        emit('"--\\n"')
+        emit('"\\n"')
+        emit('"%s");' % self.doc.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n"\n"'))
+        emit('')
+
+        keywords = self.posonly < n
+        flags = 'METH_FASTCALL | METH_KEYWORDS' if keywords else 'METH_FASTCALL'
+
+        emit('#define %s_METHODDEF    \\' % self.c_name.upper())
+        emit('    {"%s", (PyCFunction)(void(*)(void))%s, %s, %s__doc__},' % (self.name, self.c_name, flags, self.c_name))
+        emit('')
+
+        impl_args = ''.join(', %s%s%s' % (p.ctype, '' if p.ctype.endswith('*') else ' ', p.name) for p in self.params)
+
+        emit('static PyObject *')
+        emit('%s_impl(PyObject *module%s);' % (self.c_name, impl_args))
+        emit('')
+        emit('static PyObject *')
+
+        if keywords:
+            emit('%s(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)' % self.c_name)
+        else:
+            emit('%s(PyObject *module, PyObject *const *args, Py_ssize_t nargs)' % self.c_name)
+
+        emit('{')
+        emit('    PyObject *return_value = NULL;')
+
+        if keywords:
+            emit('    static const char * const _keywords[] = {%s};' % ', '.join('"%s"' % p.name for p in self.params))
+            emit('    static PyObject *_interned[%d];' % n)
+
+        if n:
+            emit('    PyObject *argsbuf[%d] = {%s};' % (n, ', '.join(['NULL'] * n)))
+
+        for p in self.params:
+            sep = '' if p.ctype.endswith('*') else ' '
+
+            if p.default is None:
+                emit('    %s%s%s;' % (p.ctype, sep, p.name))
+            else:
+                emit('    %s%s%s = %s;' % (p.ctype, sep, p.name, p.default))
+
+        if n:
+            emit('    Py_ssize_t i;')
+
+        emit('')
+
+        # With keywords, a missing argument is only known once argsbuf has been filled from args and kwnames, so it is left to the check below
+
+        if self.required == n and not keywords:
+            emit('    if (nargs != %d) {' % n)
+            emit('        PyErr_Format(PyExc_TypeError, "%s() takes exactly %d argument%s (%%zd given)", nargs);'
+                 % (fname, n, '' if n == 1 else 's'))
+        else:
+            emit('    if (nargs > %d) {' % n)
+            emit('        PyErr_Format(PyExc_TypeError, "%s() takes at most %d argument%s (%%zd given)", nargs);'
+                 % (fname, n, '' if n == 1 else 's'))
+
+        emit('        goto exit;')
+        emit('    }')
+        emit('')
+
+        if n:
+            emit('    for (i = 0; i < nargs; i++)')
+            emit('        argsbuf[i] = args[i];')
+            emit('')
+
+        if keywords:
+            emit('    if (kwnames != NULL) {')
+            emit('        if (_fastcall_intern(_interned, _keywords, %d) < 0)' % n)
+            emit('            goto exit;')
+            emit('')
+            emit('        if (_fastcall_match("%s", args, nargs, kwnames, _interned, %d, %d, argsbuf) < 0)'
+                 % (fname, self.posonly, n))
+            emit('            goto exit;')
+            emit('    }')
+            emit('')
+
+        if self.required:
+            emit('    for (i = 0; i < %d; i++) {' % self.required)
+            emit('        if (argsbuf[i] == NULL)')
+            emit('            goto missing;')
+            emit('    }')
+            emit('')
+
+        for i, p in enumerate(self.params):
+            code = CONVERTERS[p.converter][1].format(arg='argsbuf[%d]' % i, var=p.name, fname=fname, pname=p.name)
+
+            if p.default is None:
+                emit('\n'.join('    ' + line for line in code.split('\n')))
+            else:
+                emit('    if (argsbuf[%d] != NULL) {' % i)
+                emit('\n'.join('        ' + line for line in code.split('\n')))
+                emit('    }')
+
+            emit('')
+
+        emit('    return_value = %s_impl(module%s);' % (self.c_name, ''.join(', ' + p.name for p in self.params)))
+        emit('    goto exit;')
+
+        if self.required:
+            emit('')
+            emit('missing:')
+            emit('    for (i = 0; argsbuf[i] != NULL; i++)')
+            emit('        ;')
+            emit('')
+            emit('    PyErr_Format(PyExc_TypeError, "%s() missing required argument \'%%s\' (pos %%zd)",' % fname)
+            emit('                 %s[i], i + 1);' % ('_keywords' if keywords else '(const char *[]){%s}' % ', '.join('"%s"' % p.name for p in self.params)))
+
+        emit('')
+        emit('exit:')
+        emit('    return return_value;')
+        emit('}')
+
+        return '\n'.join(out) + '\n'
+
+
+def process(path):
+    with open(path, 'rb') as f:
+        data = f.read().decode('latin-1')
+
+    crlf = '\r\n' in data
+    text = data.replace('\r\n', '\n')
+    result = []
+    pos = 0
+    first = True
+
+    while True:
+        i = text.find(INPUT, pos)
+
+        if i < 0:
+            break
+
+        j = text.index(START, i)
+        k = text.index(END, j)
+        func = Function(text[i + len(INPUT):j].strip('\n'))
+        code = func.generate()
+
+        if first:
+            code = SUPPORT + '\n' + code
+            first = False
+
+        result.append(text[pos:j + len(START)] + '\n' + code)
+        pos = k
+
+    result.append(text[pos:])
+    text = ''.join(result)
+
+    if crlf:
+        text = text.replace('\n', '\r\n')
+
+    with open(path, 'wb') as f:
+        f.write(text.encode('latin-1'))
+
+
+if __name__ == '__main__':
+    for path in sys.argv[1:]:
+        process(path)
@@ -42,23 +42,257 @@ int PyArg_ParseTupleAndKeywords(PyObject *arg, PyObject *kwdict,
 
 #include "Python.h"
 
+/*
+ PyArg_ParseTupleAndKeywords() needs the arguments packed into a tuple and a dictionary, and interprets its format string on every call.
+ The same function can be declared for CPython_API_Fastcall_Clinic.py instead, which generates a METH_FASTCALL | METH_KEYWORDS wrapper with the
+ conversions written out in C and the keyword names interned in advance; the implementation then receives plain C values:
+*/
+
+/*[fastcall input]
+keywdarg.parrot
+
+    voltage: int
+    state: str = "a stiff"
+    action: str = "voom"
+    type: str = "Norwegian Blue"
+
+Print a lovely skit to standard output.
+[fastcall start generated code]*/
+#ifndef FASTCALL_SUPPORT_DEFINED
+#define FASTCALL_SUPPORT_DEFINED
+
+/* Shared helpers of the generated wrappers; emitted once per translation unit */
+
+static inline int
+_fastcall_intern(PyObject **interned, const char * const *names, Py_ssize_t n)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < n; i++) {
+        if (interned[i] == NULL) {
+            interned[i] = PyUnicode_InternFromString(names[i]);
+
+            if (interned[i] == NULL)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_match(const char *fname, PyObject *const *args, Py_ssize_t nargs,
+                PyObject *kwnames, PyObject **interned, Py_ssize_t posonly,
+                Py_ssize_t nparams, PyObject **slots)
+{
+    Py_ssize_t k, i, nkw = PyTuple_GET_SIZE(kwnames);
+
+    for (k = 0; k < nkw; k++) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+
+        /* Keyword names in calls are almost always interned as well */
+
+        for (i = posonly; i < nparams; i++) {
+            if (interned[i] == key)
+                break;
+        }
+
+        if (i == nparams) {
+            for (i = posonly; i < nparams; i++) {
+                if (PyUnicode_Compare(interned[i], key) == 0)
+                    break;
+            }
+        }
+
+        if (i == nparams) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() got an unexpected keyword argument '%S'",
+                         fname, key);
+
+            return -1;
+        }
+
+        if (i < nargs) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for %s() given by name ('%S') and position (%zd)",
+                         fname, key, i + 1);
+
+            return -1;
+        }
+
+        slots[i] = args[nargs + k];
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_str(const char *fname, const char *pname, PyObject *arg, const char **out)
+{
+    Py_ssize_t size;
+
+    if (!PyUnicode_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be str, not %.50s",
+                     fname, pname, Py_TYPE(arg)->tp_name);
+
+        return -1;
+    }
+
+    *out = PyUnicode_AsUTF8AndSize(arg, &size);
+
+    if (*out == NULL)
+        return -1;
+
+    if (strlen(*out) != (size_t) size) {
+        PyErr_SetString(PyExc_ValueError, "embedded null character");
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline int
+_fastcall_int(const char *fname, const char *pname, PyObject *arg, int *out)
+{
+    long value;
+
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    value = PyLong_AsLong(arg);
+
+    if (value == -1 && PyErr_Occurred())
+        return -1;
+
+    if (value > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is greater than maximum");
+
+        return -1;
+    }
+
+    if (value < INT_MIN) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "signed integer is less than minimum");
+
+        return -1;
+    }
+
+    *out = (int) value;
+
+    return 0;
+}
+
+static inline int
+_fastcall_ssize_t(const char *fname, const char *pname, PyObject *arg, Py_ssize_t *out)
+{
+    if (PyFloat_Check(arg)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() argument '%s' must be int, not float", fname, pname);
+
+        return -1;
+    }
+
+    *out = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (*out == -1 && PyErr_Occurred())
+        return -1;
+
+    return 0;
+}
+
+#endif /* FASTCALL_SUPPORT_DEFINED */
+
+PyDoc_STRVAR(keywdarg_parrot__doc__,
+"parrot(voltage, state='a stiff', action='voom', type='Norwegian Blue')\n"
+"--\n"
+"\n"
+"Print a lovely skit to standard output.");
+
+#define KEYWDARG_PARROT_METHODDEF    \
+    {"parrot", (PyCFunction)(void(*)(void))keywdarg_parrot, METH_FASTCALL | METH_KEYWORDS, keywdarg_parrot__doc__},
+
 static PyObject *
+keywdarg_parrot_impl(PyObject *module, int voltage, const char *state, const char *action, const char *type);
 
-keywdarg_parrot(PyObject *self, PyObject *args, PyObject *keywds)
+static PyObject *
+keywdarg_parrot(PyObject *module, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
+    PyObject *return_value = NULL;
+    static const char * const _keywords[] = {"voltage", "state", "action", "type"};
+    static PyObject *_interned[4];
+    PyObject *argsbuf[4] = {NULL, NULL, NULL, NULL};
     int voltage;
-
     const char *state = "a stiff";
     const char *action = "voom";
-
     const char *type = "Norwegian Blue";
+    Py_ssize_t i;
+
+    if (nargs > 4) {
+        PyErr_Format(PyExc_TypeError, "parrot() takes at most 4 arguments (%zd given)", nargs);
+        goto exit;
+    }
+
+    for (i = 0; i < nargs; i++)
+        argsbuf[i] = args[i];
+
+    if (kwnames != NULL) {
+        if (_fastcall_intern(_interned, _keywords, 4) < 0)
+            goto exit;
+
+        if (_fastcall_match("parrot", args, nargs, kwnames, _interned, 0, 4, argsbuf) < 0)
+            goto exit;
+    }
+
+    for (i = 0; i < 1; i++) {
+        if (argsbuf[i] == NULL)
+            goto missing;
+    }
+
+    if (_fastcall_int("parrot", "voltage", argsbuf[0], &voltage) < 0)
+        goto exit;
 
-    static char *kwlist[] = {"voltage", "state", "action", "type", NULL};
+    if (argsbuf[1] != NULL) {
+        if (_fastcall_str("parrot", "state", argsbuf[1], &state) < 0)
+            goto exit;
+    }
 
-    if (!PyArg_ParseTupleAndKeywords(args, keywds, "i|sss", kwlist,
-                                     &voltage, &state, &action, &type))
-        return NULL;
+    if (argsbuf[2] != NULL) {
+        if (_fastcall_str("parrot", "action", argsbuf[2], &action) < 0)
+            goto exit;
+    }
 
+    if (argsbuf[3] != NULL) {
+        if (_fastcall_str("parrot", "type", argsbuf[3], &type) < 0)
+            goto exit;
+    }
+
+    return_value = keywdarg_parrot_impl(module, voltage, state, action, type);
+    goto exit;
+
+missing:
+    for (i = 0; argsbuf[i] != NULL; i++)
+        ;
+
+    PyErr_Format(PyExc_TypeError, "parrot() missing required argument '%s' (pos %zd)",
+                 _keywords[i], i + 1);
+
+exit:
+    return return_value;
+}
+/*[fastcall end generated code]*/
+
+static PyObject *
+
+keywdarg_parrot_impl(PyObject *module, int voltage, const char *state,
+                     const char *action, const char *type)
+{
     printf("-- This parrot wouldn't %s if you put %i Volts through it.\n",
            action, voltage);
 
@@ -69,13 +303,12 @@ keywdarg_parrot(PyObject *self, PyObject *args, PyObject *keywds)
 
 static PyMethodDef keywdarg_methods[] = {
 
-    /* The cast of the function is necessary since PyCFunction values
+    /* The generated macro casts the function, since PyCFunction values
      * only take two PyObject* parameters, and keywdarg_parrot() takes
-     * three.
+     * four.
      */
 
-    {"parrot", (PyCFunction)keywdarg_parrot, METH_VARARGS | METH_KEYWORDS,
-     "Print a lovely skit to standard output."},
+    KEYWDARG_PARROT_METHODDEF
     {NULL, NULL, 0, NULL}   /* sentinel */
 
 };
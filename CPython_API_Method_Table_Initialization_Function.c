@@ -24,8 +24,13 @@
 static PyMethodDef SpamMethods[] = {
      /*          ...........     */
 
-    {"system",  spam_system, METH_VARARGS,
-     "Execute a shell command."},
+    SPAM_SYSTEM_METHODDEF
+    SPAM_RUN_BATCH_METHODDEF
+    SPAM_SYSTEM_ASYNC_METHODDEF
+    SPAM_PIPELINE_METHODDEF
+    SPAM_PIPELINE_LINES_METHODDEF
+    SPAM_SET_ACCOUNTING_METHODDEF
+    SPAM_STATS_METHODDEF
 
      /*          ...........           */
 
@@ -37,6 +42,8 @@ static PyMethodDef SpamMethods[] = {
  The METH_KEYWORDS bit may be set in the third field if keyword arguments should be passed to the function.
  In this case, the C function should accept a third PyObject * parameter which will be a dictionary of keywords.
  Use PyArg_ParseTupleAndKeywords() to parse the arguments to such a function.
+ The entries above are written with the *_METHODDEF macros generated by CPython_API_Fastcall_Clinic.py; they register the functions with
+ METH_FASTCALL (plus METH_KEYWORDS where keyword arguments are accepted), so the arguments arrive as a C array rather than a tuple.
  The method table must be referenced in the module definition structure:
 */ 
 
@@ -59,6 +66,10 @@ PyMODINIT_FUNC
 PyInit_spam(void)
 
 {
+    /* The iterator type returned by spam.pipeline_lines() */
+
+    if (PyType_Ready(&SpamPipelineLinesType) < 0)
+        return NULL;
 
     return PyModule_Create(&spammodule);
 
@@ -0,0 +1,44 @@
+# CPython API
+# Checks that the commands started by spam.pipeline(), spam.pipeline_lines(), spam.run_batch() and spam.system_async() get SIGPIPE back.
+# Python ignores SIGPIPE, and an ignored signal stays ignored in a child; a producer whose reader has exited would then never be stopped, so each check
+# runs under a watchdog that aborts the script instead of letting it hang.
+#
+
+import asyncio
+import faulthandler
+import time
+
+import spam
+
+faulthandler.dump_traceback_later(30, exit=True)
+
+# A producer that never ends is killed by SIGPIPE (status 13) once the last stage exits
+
+output, statuses = spam.pipeline(["while :; do echo x; done", "head -1"])
+assert output == b"x\n" and statuses == [13, 0], (output, statuses)
+
+output, statuses = spam.pipeline([["yes"], ["head", "-2"]])
+assert output == b"y\ny\n" and statuses == [13, 0], (output, statuses)
+
+# Dropping an iterator before the end of the output stops the stages, including one that is not writing
+
+for stages in [[["yes"]], ["echo x; exec sleep 60"]]:
+    lines = spam.pipeline_lines(stages)
+    assert next(lines) in (b"y\n", b"x\n")
+
+    start = time.monotonic()
+    del lines
+    assert time.monotonic() - start < 5, stages
+
+# The other ways of starting commands restore the default disposition too
+
+assert spam.run_batch(["kill -PIPE $$; exit 0"]) == [13]
+
+
+async def main():
+    return await spam.system_async("kill -PIPE $$; exit 0")
+
+
+assert asyncio.run(main()) == 13
+
+print("ok")
@@ -28,8 +28,29 @@ static int
 
 PySpam_System(const char *command)
 {
+    int sts;
+
+    /* Callers must hold the GIL, because it is released while the command runs */
+
+    Py_BEGIN_ALLOW_THREADS
+    sts = spam_shell(command);
+    Py_END_ALLOW_THREADS
 
-    return system(command);
+    return sts;
+
+}
+
+/*
+ PySpam_System() used to be callable without the GIL, and releasing it now makes such callers crash.
+ PySpam_SystemNoGIL() keeps that behaviour for them: it never touches the GIL, so it may be called from threads that do not hold it (and should not be
+ called while holding it, since it would then block every other Python thread for as long as the command runs).
+*/
+
+static int
+
+PySpam_SystemNoGIL(const char *command)
+{
+    return spam_shell(command);
 
 }
 
@@ -53,6 +74,60 @@ spam_system(PyObject *self, PyObject *args)
 
 }
 
+/*
+ Client modules that run many commands should not have to cross into this module once per command.
+ PySpam_SystemMany() runs a whole batch of shell commands in parallel through the same machinery as spam.run_batch(), with the GIL released for the
+ entire batch, and stores one status per command in out.
+ Like every function of the C API it must be called with the GIL held.
+ It returns 0 on success, or -1 with an exception set if the batch could not be prepared or started, or if a signal handler raised while it ran;
+ the commands still running are then killed.
+*/
+
+static int
+
+PySpam_SystemMany(const char **cmds, int n, int *out)
+{
+    static char *shell_argv[] = {"/bin/sh", "-c", NULL, NULL};
+    char **argv_block, ***argvs;
+    SpamChild *running;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    Py_ssize_t max_parallel = (ncpu > 0) ? ncpu : 1;
+    int i, rc;
+
+    if (n <= 0)
+        return 0;
+
+    if (max_parallel > n)
+        max_parallel = n;
+
+    argv_block = PyMem_New(char *, 4 * (size_t) n);
+    argvs = PyMem_New(char **, n);
+    running = PyMem_New(SpamChild, max_parallel);
+
+    if (argv_block == NULL || argvs == NULL || running == NULL) {
+        PyMem_Free(argv_block);
+        PyMem_Free(argvs);
+        PyMem_Free(running);
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        argvs[i] = &argv_block[4 * i];
+        memcpy(argvs[i], shell_argv, sizeof(shell_argv));
+        argvs[i][2] = (char *) cmds[i];
+    }
+
+    rc = spam_batch_run(argvs, out, n, running, max_parallel);
+
+    PyMem_Free(argv_block);
+    PyMem_Free(argvs);
+    PyMem_Free(running);
+
+    return rc;
+}
+
 /* 
  In the beginning of the module, right after the line
 */ 
@@ -68,7 +143,7 @@ spam_system(PyObject *self, PyObject *args)
 
 /* 
  The #define is used to tell the header file that it is being included in the exporting module, not a client module.
- Finally, the modules initialization function must take care of initializing the C API pointer array:
+ Finally, the modules initialization function must take care of exporting the C API structure:
 */ 
 
 PyMODINIT_FUNC
@@ -76,7 +151,13 @@ PyMODINIT_FUNC
 PyInit_spam(void)
 {
     PyObject *m;
-    static void *PySpam_API[PySpam_API_pointers];
+    static const PySpam_CAPI PySpam_API = {
+        sizeof(PySpam_CAPI),
+        PySpam_API_VERSION,
+        PySpam_System,
+        PySpam_SystemMany,
+        PySpam_SystemNoGIL,
+    };
 
     PyObject *c_api_object;
 
@@ -85,24 +166,29 @@ PyInit_spam(void)
     if (m == NULL)
         return NULL;
 
-    /* Initialize the C API pointer array */
+    /* Create a Capsule containing the API structure's address */
 
-    PySpam_API[PySpam_System_NUM] = (void *)PySpam_System;
-
-    /* Create a Capsule containing the API pointer array's address */
-
-    c_api_object = PyCapsule_New((void *)PySpam_API, "spam._C_API", NULL);
+    c_api_object = PyCapsule_New((void *) &PySpam_API, "spam._C_API_v2", NULL);
 
     if (c_api_object != NULL)
-        PyModule_AddObject(m, "_C_API", c_api_object);
+        PyModule_AddObject(m, "_C_API_v2", c_api_object);
 
     return m;
 
 }
  
 /*
- Note that PySpam_API is declared static; otherwise the pointer array would disappear when PyInit_spam() terminates!
- The bulk of the work is in the header file spammodule.h, which looks like this:
+ Note that PySpam_API is declared static; otherwise the structure would disappear when PyInit_spam() terminates!
+ The bulk of the work is in the header file spammodule.h, which looks like this.
+ Instead of an untyped array of void pointers, the exported functions are collected in a structure whose first two members record its size and the
+ version of the interface.
+ New functions are only ever appended to the end of the structure, so a client built against an older header keeps working with a newer module; the
+ version number changes only when existing members change, and then import_spam() refuses to load instead of calling through the wrong prototype.
+ The check is done once, when the client module is initialized; after that every call is a single indirect call through the cached structure pointer.
+ The structure is version 2 of the C API, and the capsule is named after it, so clients built against the old pointer-array header (version 1) fail
+ to import cleanly rather than misinterpreting the structure.
+ Version 2 also changes the contract of System: it releases the GIL while the command runs, so it must be called with the GIL held, whereas version 1
+ clients could call it from threads without the GIL; SystemNoGIL keeps that behaviour for them.
 */ 
 
 #ifndef Py_SPAMMODULE_H
@@ -115,29 +201,40 @@ extern "C" {
 
 /* C API functions */
 
-#define PySpam_System_NUM 0
-#define PySpam_System_RETURN int
-#define PySpam_System_PROTO (const char *command)
+#define PySpam_API_VERSION 2
+
+typedef struct {
+    size_t size;        /* sizeof(PySpam_CAPI) in the exporting module */
+    int version;        /* PySpam_API_VERSION of the exporting module */
 
-/* Total number of C API pointers */
+    /* Run one shell command and return its exit status; the caller must hold the GIL, which is released meanwhile */
+    int (*System)(const char *command);
 
-#define PySpam_API_pointers 1
+    /* Run n shell commands with the GIL released; 0 on success, -1 on error */
+    int (*SystemMany)(const char **cmds, int n, int *out);
+
+    /* Like System, but never touches the GIL, so it may be called without holding it */
+    int (*SystemNoGIL)(const char *command);
+} PySpam_CAPI;
 
 
 #ifdef SPAM_MODULE
 
 /* This section is used when compiling spammodule.c */
 
-static PySpam_System_RETURN PySpam_System PySpam_System_PROTO;
+static int PySpam_System(const char *command);
+static int PySpam_SystemMany(const char **cmds, int n, int *out);
+static int PySpam_SystemNoGIL(const char *command);
 
 #else
 
 /* This section is used in modules that use spammodule's API */
 
-static void **PySpam_API;
+static const PySpam_CAPI *PySpam_API;
 
-#define PySpam_System \
- (*(PySpam_System_RETURN (*)PySpam_System_PROTO) PySpam_API[PySpam_System_NUM])
+#define PySpam_System (PySpam_API->System)
+#define PySpam_SystemMany (PySpam_API->SystemMany)
+#define PySpam_SystemNoGIL (PySpam_API->SystemNoGIL)
 
 /* Return -1 on error, 0 on success.
  * PyCapsule_Import will set an exception if there's an error.
@@ -148,9 +245,26 @@ static int
 import_spam(void)
 
 {
+    const PySpam_CAPI *api;
+
+    api = (const PySpam_CAPI *)PyCapsule_Import("spam._C_API_v2", 0);
+
+    if (api == NULL)
+        return -1;
+
+    if (api->version != PySpam_API_VERSION || api->size < sizeof(PySpam_CAPI)) {
+        PyErr_Format(PyExc_ImportError,
+                     "spam C API version %d (%zu bytes) is not compatible "
+                     "with version %d (%zu bytes)",
+                     api->version, api->size,
+                     PySpam_API_VERSION, sizeof(PySpam_CAPI));
+
+        return -1;
+    }
+
+    PySpam_API = api;
 
-    PySpam_API = (void **)PyCapsule_Import("spam._C_API", 0);
-    return (PySpam_API != NULL) ? 0 : -1;
+    return 0;
 
 }
 
@@ -165,7 +279,7 @@ import_spam(void)
 #endif /* !defined(Py_SPAMMODULE_H) */
 
 /* 
- All that a client module must do in order to have access to the function PySpam_System() is to call the function (or rather macro) import_spam() in its
+ All that a client module must do in order to have access to the functions PySpam_System(), PySpam_SystemMany() and PySpam_SystemNoGIL() is to call the function (or rather macro) import_spam() in its
  initialization function:
 */ 
 
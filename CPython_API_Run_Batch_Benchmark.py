@@ -0,0 +1,28 @@
+# CPython API
+# Benchmark for spam.run_batch().
+# spam.system() runs one command at a time through /bin/sh, while spam.run_batch() spawns the whole batch with posix_spawn(), keeps up to
+# max_parallel processes running and waits for them with the GIL released.
+# Both calls below run the same commands; the shell-free argv form skips the /bin/sh process entirely.
+#
+
+import os
+import time
+
+import spam
+
+N = 2000
+commands = ["true"] * N
+argv_commands = [["true"]] * N
+
+def bench(label, func):
+    start = time.perf_counter()
+    statuses = func()
+    elapsed = time.perf_counter() - start
+
+    assert all(sts == 0 for sts in statuses)
+    print("%-32s %8.3f s  %10.0f commands/s" % (label, elapsed, N / elapsed))
+
+bench("loop of spam.system", lambda: [spam.system(cmd) for cmd in commands])
+bench("run_batch, shell, 1 worker", lambda: spam.run_batch(commands, max_parallel=1))
+bench("run_batch, shell", lambda: spam.run_batch(commands, max_parallel=os.cpu_count()))
+bench("run_batch, argv", lambda: spam.run_batch(argv_commands, max_parallel=os.cpu_count()))
@@ -0,0 +1,40 @@
+# CPython Defining Extension Types.
+# Checks that custom4.dump() can write over a file that an array returned by custom4.load(path, mmap=True) still maps.
+# Truncating the mapped file would make the next access to the array fault with SIGBUS; dump() must replace the file instead, leaving the array with the
+# old contents and giving the next load() the new ones.
+#
+
+import os
+import tempfile
+
+import custom4
+
+old = [custom4.Custom("first%d" % i, "last%d" % i, i) for i in range(10000)]
+new = [custom4.Custom("x", "y", -1)]
+
+with tempfile.TemporaryDirectory() as directory:
+    path = os.path.join(directory, "records.cus4")
+
+    custom4.dump(old, path)
+    mapped = custom4.load(path, mmap=True)
+
+    custom4.dump(new, path)
+
+    assert mapped.sum() == sum(range(10000)), mapped.sum()
+    assert len(mapped) == 10000 and mapped[9999].first == "first9999"
+
+    for loaded in (custom4.load(path), custom4.load(path, mmap=True)):
+        assert len(loaded) == 1 and loaded.sum() == -1 and loaded[0].last == "y"
+
+    # No temporary file is left behind, even when the rename fails
+
+    try:
+        custom4.dump(new, directory)
+    except OSError:
+        pass
+    else:
+        raise AssertionError("dump() replaced a directory")
+
+    assert os.listdir(directory) == ["records.cus4"], os.listdir(directory)
+
+print("ok")
@@ -0,0 +1,46 @@
+# CPython Defining Extension Types.
+# Benchmark for SubList.reserve() and SubList.extend_from_buffer().
+# Builds a list of N numbers with list.extend() from a generator and from an array.array, and with SubList.extend_from_buffer() from the same array,
+# in object mode and in the int64 mode; then appends N numbers one at a time, with and without reserve().
+#
+
+import array
+import timeit
+
+from sublist import SubList
+
+N = 1000000
+
+numbers = array.array("q", range(N))
+floats = array.array("d", range(N))
+
+
+def append_all(lst):
+    append = lst.append
+
+    for i in range(N):
+        append(i)
+
+
+def reserve_and_append_all(lst):
+    lst.reserve(N)
+    append_all(lst)
+
+
+for label, stmt in [
+    ("list.extend(generator)", "[].extend(i for i in range(N))"),
+    ("SubList.extend(generator)", "SubList().extend(i for i in range(N))"),
+    ("list.extend(array 'q')", "[].extend(numbers)"),
+    ("SubList.extend_from_buffer('q')", "SubList().extend_from_buffer(numbers)"),
+    ("int64 SubList.extend(array 'q')", "SubList(dtype='int64').extend(numbers)"),
+    ("int64 SubList.extend_from_buffer('q')", "SubList(dtype='int64').extend_from_buffer(numbers)"),
+    ("list.extend(array 'd')", "[].extend(floats)"),
+    ("SubList.extend_from_buffer('d')", "SubList().extend_from_buffer(floats)"),
+    ("list.append() x N", "append_all([])"),
+    ("SubList.append() x N", "append_all(SubList())"),
+    ("SubList.reserve(N), append() x N", "reserve_and_append_all(SubList())"),
+    ("int64 SubList.append() x N", "append_all(SubList(dtype='int64'))"),
+    ("int64 reserve(N), append() x N", "reserve_and_append_all(SubList(dtype='int64'))"),
+]:
+    seconds = min(timeit.repeat(stmt, globals=globals(), number=1, repeat=5))
+    print("%-40s %7.1f ms  %6.1f ns/element" % (label, seconds * 1e3, seconds / N * 1e9))
@@ -0,0 +1,27 @@
+# CPython Defining Extension Types.
+# Benchmark for custom4.Custom.from_columns().
+# Builds the same list of Custom objects with a list comprehension that calls Custom() once per row, and with from_columns() given the numbers as a
+# list and as an array.array buffer.
+#
+
+import array
+import timeit
+
+import custom4
+
+N = 100000
+
+firsts = ["first%d" % (i % 100) for i in range(N)]
+lasts = ["last%d" % (i % 1000) for i in range(N)]
+numbers = list(range(N))
+buffer = array.array("i", numbers)
+
+Custom = custom4.Custom
+
+for label, stmt in [
+    ("[Custom(f, l, n) for ...]", "[Custom(f, l, n) for f, l, n in zip(firsts, lasts, numbers)]"),
+    ("Custom.from_columns(list)", "Custom.from_columns(firsts, lasts, numbers)"),
+    ("Custom.from_columns(array)", "Custom.from_columns(firsts, lasts, buffer)"),
+]:
+    seconds = min(timeit.repeat(stmt, globals=globals(), number=10, repeat=5)) / 10
+    print("%-30s %7.1f ns/object" % (label, seconds / N * 1e9))
@@ -0,0 +1,73 @@
+# CPython Defining Extension Types.
+# Benchmark for the sharded SubList.increment() counter.
+# T threads increment the same SubList, for T = 1, 2, 4, ..., up to twice the number of CPUs, and the total throughput is compared with that of one
+# thread; with the sharded counter it should grow almost linearly on a free-threaded build, as long as there are idle CPUs.
+# For comparison the same threads increment a plain attribute under a threading.Lock.
+# On a build with the GIL only one thread runs at a time, so neither counter can scale there.
+#
+
+import os
+import sys
+import threading
+import time
+
+from sublist import SubList
+
+INCREMENTS = 200000
+
+
+class LockedCounter:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.state = 0
+
+    def increment(self):
+        with self.lock:
+            self.state += 1
+
+            return self.state
+
+
+def run(counter, threads):
+    barrier = threading.Barrier(threads + 1)
+
+    def work():
+        increment = counter.increment
+        barrier.wait()
+
+        for i in range(INCREMENTS):
+            increment()
+
+    workers = [threading.Thread(target=work) for i in range(threads)]
+
+    for w in workers:
+        w.start()
+
+    barrier.wait()
+    start = time.perf_counter()
+
+    for w in workers:
+        w.join()
+
+    seconds = time.perf_counter() - start
+
+    assert counter.state == threads * INCREMENTS
+    return threads * INCREMENTS / seconds
+
+
+gil = getattr(sys, "_is_gil_enabled", lambda: True)()
+cpus = os.cpu_count() or 1
+print("Python %s, GIL %s, %d CPUs" % (sys.version.split()[0], "enabled" if gil else "disabled", cpus))
+
+counts = [1]
+
+while counts[-1] < 2 * cpus:
+    counts.append(counts[-1] * 2)
+
+for label, make in [("SubList.increment()", SubList), ("threading.Lock counter", LockedCounter)]:
+    base = None
+
+    for threads in counts:
+        rate = max(run(make(), threads) for i in range(3))
+        base = base or rate
+        print("%-24s %3d threads  %7.2f M increments/s  x%.2f" % (label, threads, rate / 1e6, rate / base))
@@ -0,0 +1,22 @@
+# CPython Defining Extension Types.
+# Benchmark for the cached name of custom4.Custom.
+# With the default build Custom.name() formats the name once and then returns the cached string until first or last is assigned again; build the
+# module with -DCUSTOM_CACHE_NAME=0 and run this again to see the cost of formatting it on every call.
+# The last row assigns first before every call, so it always misses the cache.
+#
+
+import timeit
+
+import custom4
+
+obj = custom4.Custom("Graham", "Chapman", 1)
+
+N = 1000000
+
+for label, stmt in [
+    ("obj.name()", "obj.name()"),
+    ("10 x obj.name()", "name(); name(); name(); name(); name(); name(); name(); name(); name(); name()"),
+    ("obj.first = 'Eric'; obj.name()", "obj.first = 'Eric'; obj.name()"),
+]:
+    seconds = min(timeit.repeat(stmt, globals={"obj": obj, "name": obj.name}, number=N, repeat=5))
+    print("%-40s %7.1f ns/loop" % (label, seconds / N * 1e9))
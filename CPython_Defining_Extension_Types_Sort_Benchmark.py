@@ -0,0 +1,29 @@
+# CPython Defining Extension Types.
+# Benchmark for custom4.sort().
+# Sorts the same list of Custom objects by (last, first, number) and by number alone, with sorted() and a key function, and with custom4.sort() on
+# one thread and with the parallel merge.
+#
+
+import random
+import timeit
+
+import custom4
+
+N = 1000000
+
+random.seed(0)
+objs = custom4.Custom.from_columns(
+    ["first%d" % random.randrange(5000) for i in range(N)],
+    ["last%d" % random.randrange(50000) for i in range(N)],
+    [random.randrange(-10**9, 10**9) for i in range(N)],
+)
+
+for label, stmt in [
+    ("sorted(key=(last, first, number))", "sorted(objs, key=lambda c: (c.last, c.first, c.number))"),
+    ("custom4.sort(parallel=False)", "custom4.sort(objs, parallel=False)"),
+    ("custom4.sort()", "custom4.sort(objs)"),
+    ("sorted(key=number)", "sorted(objs, key=lambda c: c.number)"),
+    ("custom4.sort(keys='number')", "custom4.sort(objs, keys='number')"),
+]:
+    seconds = min(timeit.repeat(stmt, globals=globals(), number=1, repeat=3))
+    print("%-36s %7.1f ms  %6.2f M objects/s" % (label, seconds * 1e3, N / seconds / 1e6))
@@ -0,0 +1,118 @@
+# CPython Defining Extension Types.
+# Checks that a TypedSubList never loses its elements silently when it is handed to standard library code.
+# heapq, json and the methods of list read the storage of anything PyList_Check() accepts, so a TypedSubList must not be a list and they must refuse
+# it; bisect and array.array() go through the sequence protocol and must see the elements. An object mode SubList works with all of them, as any list
+# does, and its sum(), min() and max() stay right however they change it.
+#
+
+import array
+import bisect
+import copy
+import heapq
+import json
+import pickle
+
+from sublist import SubList, TypedSubList
+
+values = [5, 3, 8, 1, 9, 2]
+
+# The type
+
+typed = SubList(values, dtype="int64")
+assert type(typed) is TypedSubList and not isinstance(typed, (list, SubList))
+assert type(TypedSubList(values)) is TypedSubList and TypedSubList(values) == typed
+
+for restored in [pickle.loads(pickle.dumps(typed)), copy.copy(typed), copy.deepcopy(typed)]:
+    assert type(restored) is TypedSubList and restored == values
+
+# heapq, json and list methods
+
+for func, args in [(heapq.heapify, ()), (heapq.heappush, (4,)), (heapq.heappop, ()), (json.dumps, ()), (list.append, (4,)),
+                   (list.__setitem__, (0, 4)), (list.__len__, ())]:
+    try:
+        func(typed, *args)
+    except TypeError:
+        pass
+    else:
+        raise AssertionError("%s() accepted a TypedSubList" % func.__name__)
+
+assert typed == values and json.dumps(typed.tolist()) == json.dumps(values)
+
+# Values that the array cannot hold are refused, and leave it unchanged
+
+for value in [1.5, "1", 2 ** 63]:
+    for change in [lambda: typed.append(value), lambda: typed.insert(0, value), lambda: typed.__setitem__(0, value),
+                   lambda: typed.__setitem__(slice(0, 2), [7, value]), lambda: typed.extend([7, value])]:
+        try:
+            change()
+        except (TypeError, OverflowError):
+            pass
+        else:
+            raise AssertionError("a TypedSubList accepted %r" % (value,))
+
+        del typed[len(values):]
+        assert typed == values
+
+typed.insert(-1, 7)
+typed.remove(8)
+typed[1:3] = [4, 4, 4]
+typed.sort()
+assert typed == sorted([5, 4, 4, 4, 9, 7, 2]) and typed.sum() == 35
+
+heap = SubList(values)
+heapq.heapify(heap)
+heapq.heappush(heap, 4)
+assert [heapq.heappop(heap) for _ in range(len(heap))] == sorted(values + [4])
+
+# bisect
+
+typed = TypedSubList(sorted(values))
+assert bisect.bisect_left(typed, 5) == bisect.bisect_left(sorted(values), 5)
+assert bisect.bisect_right(typed, 5) == bisect.bisect_right(sorted(values), 5)
+
+bisect.insort(typed, 4)
+assert typed == sorted(values + [4])
+
+# array
+
+typed = SubList(values, dtype="int64")
+assert array.array("q", typed) == array.array("q", values)
+assert array.array("q", SubList(values)) == array.array("q", values)
+
+typed = SubList(dtype="int64")
+typed.extend_from_buffer(array.array("q", values))
+assert typed == values and typed.sum() == sum(values)
+
+# sum(), min() and max() after heapq and list methods changed the list storage behind the SubList's back; running aggregates would not notice, so
+# only a TypedSubList keeps them
+
+try:
+    SubList(values, aggregates=True)
+except ValueError:
+    pass
+else:
+    raise AssertionError("an object mode SubList accepted aggregates=True")
+
+heap = SubList([5, 3, 1])
+assert heap.max() == 5
+
+heapq.heapify(heap)
+heapq.heapreplace(heap, 100)
+assert heap.max() == 100 and heap.min() == 3 and heap.sum() == 108
+
+list.__setitem__(heap, 0, 99)
+assert heap.max() == 100 and heap.min() == 5 and heap.sum() == 204
+
+heapq.heappush(heap, -7)
+list.append(heap, 17)
+assert heap.sum() == sum(list(heap)) and heap.min() == -7 and heap.max() == 100
+
+typed = TypedSubList([5, 3, 1], aggregates=True)
+assert typed.max() == 5 and typed.sum() == 9
+
+typed[0] = 100
+typed.append(-7)
+typed.remove(3)
+assert typed.max() == 100 and typed.min() == -7 and typed.sum() == 94
+
+print("ok")
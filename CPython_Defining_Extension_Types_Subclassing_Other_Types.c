@@ -32,25 +32,1950 @@
 */
 
 #include <Python.h>
+#include <stdint.h>
+
+/*
+ The atomic operations of the state counter below: the GCC builtins, C11 atomics, or the Interlocked functions of MSVC, all of which work on 64-bit
+ numbers on 32-bit targets too.
+ SUBLIST_ATOMIC(type) declares a variable that they are used on, and the _PTR forms are for pointers.
+ The counts need no ordering, so they are added and read relaxed; the shards pointer is published with a compare-and-swap and read with acquire, so a
+ thread that sees it also sees the zeroed shards.
+*/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SUBLIST_ATOMIC(type) type
+#define SUBLIST_THREAD_LOCAL _Thread_local
+#define SUBLIST_ATOMIC_ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#define SUBLIST_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define SUBLIST_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define SUBLIST_ATOMIC_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SUBLIST_ATOMIC_CAS_PTR(p, expected, v) \
+    __atomic_compare_exchange_n((p), (expected), (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define SUBLIST_ATOMIC(type) _Atomic(type)
+#define SUBLIST_THREAD_LOCAL _Thread_local
+#define SUBLIST_ATOMIC_ADD(p, n) atomic_fetch_add_explicit((p), (n), memory_order_relaxed)
+#define SUBLIST_ATOMIC_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+#define SUBLIST_ATOMIC_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+#define SUBLIST_ATOMIC_LOAD_PTR(p) atomic_load_explicit((p), memory_order_acquire)
+#define SUBLIST_ATOMIC_CAS_PTR(p, expected, v) \
+    atomic_compare_exchange_strong_explicit((p), (expected), (v), memory_order_acq_rel, memory_order_acquire)
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define SUBLIST_ATOMIC(type) type volatile
+#define SUBLIST_THREAD_LOCAL __declspec(thread)
+#define SUBLIST_ATOMIC_ADD(p, n) ((uint64_t) InterlockedExchangeAdd64((LONG64 volatile *) (p), (LONG64) (n)))
+#define SUBLIST_ATOMIC_LOAD(p) ((uint64_t) InterlockedCompareExchange64((LONG64 volatile *) (p), 0, 0))
+#define SUBLIST_ATOMIC_STORE(p, v) ((void) InterlockedExchange64((LONG64 volatile *) (p), (LONG64) (v)))
+#define SUBLIST_ATOMIC_LOAD_PTR(p) InterlockedCompareExchangePointer((PVOID volatile *) (p), NULL, NULL)
+#define SUBLIST_ATOMIC_CAS_PTR(p, expected, v) SubList_cas_ptr((PVOID volatile *) (p), (PVOID *) (expected), (v))
+
+static int
+
+SubList_cas_ptr(PVOID volatile *p, PVOID *expected, PVOID v)
+{
+    PVOID old = InterlockedCompareExchangePointer(p, v, *expected);
+
+    if (old == *expected)
+        return 1;
+
+    *expected = old;
+
+    return 0;
+}
+#else
+#error "SubList needs atomic operations: GCC, Clang, MSVC or a C11 compiler with <stdatomic.h>"
+#endif
+
+/* The storage modes of a SubList */
+
+#define SUBLIST_OBJECT 0    /* a SubList: the elements are in the list, as for any list */
+#define SUBLIST_INT64  1    /* a TypedSubList: the elements are in items, and the list part is not used */
+
+typedef struct SubListShard SubListShard;
+
+typedef struct {
+    PyListObject list;
+    SUBLIST_ATOMIC(SubListShard *) shards;  /* the state counter */
+    int dtype;              /* SUBLIST_OBJECT or SUBLIST_INT64 */
+    int64_t *items;
+    Py_ssize_t size, allocated;
+    int aggregates;         /* keep the running aggregates below; a TypedSubList only */
+    int sum_valid, minmax_valid;
+    unsigned long long version;
+    uint64_t sum_hi, sum_lo;
+    int64_t min, max;
+} SubListObject;
+
+static PyTypeObject SubListType, SubListTypedType;
+
+#define SubListTyped_Check(op) Py_IS_TYPE((op), &SubListTypedType)
+#define SubList_Check(op) (PyObject_TypeCheck((op), &SubListType) || SubListTyped_Check(op))     /* either type */
+
+#ifndef Py_TPFLAGS_SEQUENCE
+#define Py_TPFLAGS_SEQUENCE 0   /* before 3.10, match statements do not exist */
+#endif
+
+/*
+ The state counter:
+ A plain int counter is only consistent as long as the GIL serializes the increments; without it, threads incrementing the same SubList would lose
+ updates, and an atomic or locked counter would make them all fight over one cache line.
+ The counter is therefore split into SUBLIST_SHARDS shards, each on cache lines of its own, which are allocated the first time increment() is called.
+ A thread is given a shard the first time it increments any SubList and always increments that one; threads only share a shard when there are more of
+ them than shards, and then the atomic addition keeps the count right.
+ increment() adds to the shard of the calling thread only, and returns the new count as the state attribute reads it, as the sum of the shards.
+ That sum takes one relaxed load per shard, which reads the other threads' lines but never writes them; while other threads increment, it counts this
+ increment and some of theirs.
+*/
+
+#ifndef SUBLIST_SHARDS
+#define SUBLIST_SHARDS 16   /* a power of two */
+#endif
+
+/* Two cache lines, since neighbouring lines are fetched in pairs */
+
+struct SubListShard {
+    SUBLIST_ATOMIC(uint64_t) count;
+    char padding[128 - sizeof(SUBLIST_ATOMIC(uint64_t))];
+};
+
+static SUBLIST_ATOMIC(uint64_t) SubList_next_shard = 0;
+static SUBLIST_THREAD_LOCAL unsigned int SubList_thread_shard = 0;   /* one more than the shard of the thread, 0 before its first increment */
+
+static SubListShard *
+
+SubList_shards(SubListObject *self)
+{
+    SubListShard *shards = SUBLIST_ATOMIC_LOAD_PTR(&self->shards), *expected = NULL;
+
+    if (shards != NULL)
+        return shards;
+
+    if ((shards = PyMem_Calloc(SUBLIST_SHARDS, sizeof(SubListShard))) == NULL) {
+        PyErr_NoMemory();
+
+        return NULL;
+    }
+
+    /* Another thread may have got there first */
+
+    if (!SUBLIST_ATOMIC_CAS_PTR(&self->shards, &expected, shards)) {
+        PyMem_Free(shards);
+        shards = expected;
+    }
+
+    return shards;
+}
+
+static uint64_t SubList_state(SubListObject *self);
+
+static PyObject *
+
+SubList_increment(SubListObject *self, PyObject *unused)
+{
+    SubListShard *shards = SubList_shards(self);
+
+    if (shards == NULL)
+        return NULL;
+
+    if (SubList_thread_shard == 0)
+        SubList_thread_shard = (unsigned int) (SUBLIST_ATOMIC_ADD(&SubList_next_shard, 1) % SUBLIST_SHARDS) + 1;
+
+    SUBLIST_ATOMIC_ADD(&shards[SubList_thread_shard - 1].count, 1);
+
+    return PyLong_FromUnsignedLongLong(SubList_state(self));
+}
+
+static uint64_t
+
+SubList_state(SubListObject *self)
+{
+    SubListShard *shards = SUBLIST_ATOMIC_LOAD_PTR(&self->shards);
+    uint64_t state = 0;
+    int i;
+
+    for (i = 0; shards != NULL && i < SUBLIST_SHARDS; i++)
+        state += SUBLIST_ATOMIC_LOAD(&shards[i].count);
+
+    return state;
+}
+
+static void
+
+SubList_reset_state(SubListObject *self)
+{
+    SubListShard *shards = SUBLIST_ATOMIC_LOAD_PTR(&self->shards);
+    int i;
+
+    for (i = 0; shards != NULL && i < SUBLIST_SHARDS; i++)
+        SUBLIST_ATOMIC_STORE(&shards[i].count, 0);
+}
+
+/*
+ A typed storage mode:
+ A list of numbers stores a pointer to an int object for every element, so a million numbers take a million objects.
+ SubList(iterable, dtype="int64") returns a TypedSubList instead, which keeps its elements in a contiguous array of int64_t and creates an int object
+ only when an element is read; sublist.TypedSubList(iterable) does the same.
+ C code that checks for a list with PyList_Check() reads the list storage directly, as heapq and json do, so a list whose elements are somewhere else
+ cannot be a list subclass: a TypedSubList is a sequence of its own, as array.array is, and does not derive from list or SubList.
+ heapq, json and the methods of list itself refuse it with TypeError, code that uses the sequence protocol, such as bisect and array.array(), sees its
+ elements, and list(obj) or obj.tolist() makes an ordinary list of it.
+ It has the methods and operators of a list and of SubList: indexing, assignment and deletion of single elements, len(), iteration, in, append(),
+ extend(), insert(), pop(), remove(), clear(), count(), reverse(), sort() without a key, +=, *=, comparisons and repr() work on the array directly;
+ index(), copy(), reversed(), + and * work on a temporary list, and slice assignment and sort() with a key change a temporary list whose elements are
+ then stored back all at once.
+ Like array('q'), it only holds ints between -2**63 and 2**63 - 1; storing anything else raises TypeError or OverflowError and leaves it unchanged.
+ Subclasses of SubList cannot have a typed counterpart, so they do not accept dtype="int64", and TypedSubList cannot be subclassed.
+ Both types share the SubListObject structure, so the functions below serve both of them and branch on dtype; the list part of a TypedSubList is never
+ used.
+ sum(), min(), max() and count() of a TypedSubList are plain loops over the array that the compiler vectorizes; in object mode they do what the
+ built-in functions and list.count() do.
+*/
+
+/* Convert a value for the array, raising TypeError or OverflowError if it cannot hold it */
+
+static int
+
+SubList_convert(PyObject *value, int64_t *out)
+{
+    long long v;
+
+    if (!PyLong_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "TypedSubList elements must be int, not %.100s", Py_TYPE(value)->tp_name);
+
+        return -1;
+    }
+
+    v = PyLong_AsLongLong(value);
+
+    if (v == -1 && PyErr_Occurred())
+        return -1;
+
+    *out = v;
+
+    return 0;
+}
+
+/* Make room for n more typed elements */
+
+static int
+
+SubList_reserve_items(SubListObject *self, Py_ssize_t n)
+{
+    Py_ssize_t allocated;
+    int64_t *items;
+
+    if (self->size + n <= self->allocated)
+        return 0;
+
+    if (n > PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(int64_t) - self->size) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    allocated = self->size + n;
+    allocated += Py_MIN(allocated >> 3, PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(int64_t) - allocated) + 6;
+    items = PyMem_Realloc(self->items, allocated * sizeof(int64_t));
+
+    if (items == NULL) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    self->items = items;
+    self->allocated = allocated;
+
+    return 0;
+}
+
+/*
+ Running aggregates:
+ A TypedSubList created with aggregates=True keeps its sum, minimum and maximum up to date as it changes, so sum(), min() and max() return them without a
+ pass over the elements.
+ Every change reports the elements it added and removed to SubList_added_int() and SubList_removed_int(); a change that cannot be applied to an
+ aggregate, such as the removal of the current minimum or a slice assignment, marks it invalid instead, and the next query recomputes it with a full pass.
+ The sum is kept as a 128-bit number, which holds the exact sum of up to 2**63 elements.
+ Only the array of a TypedSubList is sure to change through its own methods: heapq, the methods of list itself and PyList_SetItem() from C change the
+ storage of a SubList without it knowing, so that it could not tell whether aggregates it kept are still right.
+ SubList(aggregates=True) without dtype="int64" therefore raises ValueError, and sum(), min() and max() of a SubList do what the built-in functions do.
+ version counts the changes made through either type, as state counts the calls of increment().
+*/
+
+static void
+
+SubList_forget(SubListObject *self)
+{
+    self->sum_valid = self->minmax_valid = 0;
+}
+
+/* A change that the aggregates cannot follow */
+
+static void
+
+SubList_changed(SubListObject *self)
+{
+    self->version++;
+
+    SubList_forget(self);
+}
+
+/* The list was emptied */
+
+static void
+
+SubList_emptied(SubListObject *self)
+{
+    SubList_changed(self);
+
+    if (!self->aggregates)
+        return;
+
+    self->sum_hi = self->sum_lo = 0;
+    self->min = INT64_MAX;
+    self->max = INT64_MIN;
+    self->sum_valid = self->minmax_valid = 1;
+}
+
+/* The elements were reordered, which leaves the aggregates of ints as they are */
+
+static void
+
+SubList_reordered(SubListObject *self)
+{
+    self->version++;
+}
+
+static void
+
+SubList_added_int(SubListObject *self, int64_t v)
+{
+    uint64_t u = (uint64_t) v;
+
+    self->version++;
+
+    if (!self->aggregates)
+        return;
+
+    self->sum_lo += u;
+    self->sum_hi += ((v < 0) ? UINT64_MAX : 0) + (self->sum_lo < u);
+
+    if (v < self->min)
+        self->min = v;
+
+    if (v > self->max)
+        self->max = v;
+}
+
+static void
+
+SubList_removed_int(SubListObject *self, int64_t v)
+{
+    uint64_t u = (uint64_t) v, borrow = self->sum_lo < u;
+
+    self->version++;
+
+    if (!self->aggregates)
+        return;
+
+    self->sum_lo -= u;
+    self->sum_hi -= ((v < 0) ? UINT64_MAX : 0) + borrow;
+
+    if (v == self->min || v == self->max)
+        self->minmax_valid = 0;
+}
+
+/* An int object for a 128-bit two's complement number */
+
+static PyObject *
+
+SubList_int128(uint64_t hi, uint64_t lo)
+{
+    PyObject *h, *l, *shift, *res = NULL;
+
+    if (hi == (((int64_t) lo < 0) ? UINT64_MAX : 0))
+        return PyLong_FromLongLong((int64_t) lo);
+
+    h = PyLong_FromLongLong((int64_t) hi);
+    l = PyLong_FromUnsignedLongLong(lo);
+    shift = PyLong_FromLong(64);
+
+    if (h != NULL && l != NULL && shift != NULL) {
+        Py_SETREF(h, PyNumber_Lshift(h, shift));
+
+        if (h != NULL)
+            res = PyNumber_Add(h, l);
+    }
+
+    Py_XDECREF(h);
+    Py_XDECREF(l);
+    Py_XDECREF(shift);
+
+    return res;
+}
+
+/* The elements were repeated n > 0 times */
+
+static void
+
+SubList_repeated(SubListObject *self, Py_ssize_t n)
+{
+    self->version++;
+
+    if (self->aggregates)
+        self->sum_valid = 0;
+}
+
+/* Return an ordinary list with the elements */
+
+static PyObject *
+
+SubList_tolist(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *list;
+    Py_ssize_t i;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_GetSlice((PyObject *) self, 0, PY_SSIZE_T_MAX);
+
+    if ((list = PyList_New(self->size)) == NULL)
+        return NULL;
+
+    for (i = 0; i < self->size; i++) {
+        PyObject *item = PyLong_FromLongLong(self->items[i]);
+
+        if (item == NULL) {
+            Py_DECREF(list);
+
+            return NULL;
+        }
+
+        PyList_SET_ITEM(list, i, item);
+    }
+
+    return list;
+}
+
+/* Replace the elements of a TypedSubList with those of a list, all of which are converted before any is stored */
+
+static int
+
+SubList_store(SubListObject *self, PyObject *list)
+{
+    Py_ssize_t i, n = PyList_GET_SIZE(list);
+    int64_t *items = PyMem_New(int64_t, n);
+
+    if (items == NULL) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (SubList_convert(PyList_GET_ITEM(list, i), &items[i]) < 0) {
+            PyMem_Free(items);
+
+            return -1;
+        }
+    }
+
+    PyMem_Free(self->items);
+    self->items = items;
+    self->size = self->allocated = n;
+
+    return 0;
+}
+
+/* A new reference to an ordinary list, or to any other object, with the same elements */
+
+static PyObject *
+
+SubList_as_list(PyObject *obj)
+{
+    if (SubListTyped_Check(obj))
+        return SubList_tolist((SubListObject *) obj, NULL);
+
+    Py_INCREF(obj);
+
+    return obj;
+}
+
+/* Call the list method name on a SubList, or on a temporary list with the elements of a TypedSubList, which the method must not change */
+
+static PyObject *
+
+SubList_delegate(SubListObject *self, const char *name, PyObject *args, PyObject *kwds)
+{
+    PyObject *target, *func, *full, *res = NULL;
+    Py_ssize_t i, n = args ? PyTuple_GET_SIZE(args) : 0;
+
+    if ((target = SubList_as_list((PyObject *) self)) == NULL)
+        return NULL;
+
+    func = PyObject_GetAttrString((PyObject *) &PyList_Type, name);
+    full = PyTuple_New(n + 1);
+
+    if (func != NULL && full != NULL) {
+        PyTuple_SET_ITEM(full, 0, target);
+        target = NULL;
+
+        for (i = 0; i < n; i++) {
+            Py_INCREF(PyTuple_GET_ITEM(args, i));
+            PyTuple_SET_ITEM(full, i + 1, PyTuple_GET_ITEM(args, i));
+        }
+
+        res = PyObject_Call(func, full, kwds);
+    }
+
+    Py_XDECREF(target);
+    Py_XDECREF(func);
+    Py_XDECREF(full);
+
+    return res;
+}
+
+static PyObject *
+
+SubList_delegate1(SubListObject *self, const char *name, PyObject *arg)
+{
+    PyObject *args = PyTuple_Pack(1, arg), *res;
+
+    if (args == NULL)
+        return NULL;
+
+    res = SubList_delegate(self, name, args, NULL);
+    Py_DECREF(args);
+
+    return res;
+}
+
+#define SUBLIST_DELEGATE(name)                                                      \
+    static PyObject *                                                               \
+    SubList_##name(SubListObject *self, PyObject *args, PyObject *kwds)             \
+    {                                                                               \
+        return SubList_delegate(self, #name, args, kwds);                           \
+    }
+
+SUBLIST_DELEGATE(index)
+SUBLIST_DELEGATE(__reversed__)
+
+static PyObject *
+
+SubList_reverse(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    Py_ssize_t i, j;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        PyObject *res = SubList_delegate(self, "reverse", NULL, NULL);
+
+        SubList_reordered(self);
+
+        return res;
+    }
+
+    for (i = 0, j = self->size - 1; i < j; i++, j--) {
+        int64_t v = self->items[i];
+
+        self->items[i] = self->items[j];
+        self->items[j] = v;
+    }
+
+    SubList_reordered(self);
+
+    Py_RETURN_NONE;
+}
+
+static int
+
+SubList_compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Equal ints cannot be told apart, so without a key the array is sorted in place; a key function is given the elements as ints, on a temporary list */
+
+static PyObject *
+
+SubList_sort(SubListObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"key", "reverse", NULL};
+
+    PyObject *key = Py_None, *list, *sort, *res = NULL;
+    unsigned long long version;
+    int reverse = 0;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        res = SubList_delegate(self, "sort", args, kwds);
+
+        SubList_reordered(self);
+
+        return res;
+    }
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$Op:sort", kwlist, &key, &reverse))
+        return NULL;
+
+    if (key == Py_None) {
+        if (self->size > 1)
+            qsort(self->items, self->size, sizeof(int64_t), SubList_compare_int64);
+
+        if (reverse)
+            return SubList_reverse(self, NULL);
+
+        SubList_reordered(self);
+
+        Py_RETURN_NONE;
+    }
+
+    if ((list = SubList_tolist(self, NULL)) == NULL)
+        return NULL;
+
+    version = self->version;
+
+    if ((sort = PyObject_GetAttrString(list, "sort")) != NULL) {
+        res = PyObject_Call(sort, args, kwds);
+        Py_DECREF(sort);
+    }
+
+    /* As list.sort() does, refuse to store the result over changes that the key function made */
+
+    if (res != NULL && self->version != version) {
+        PyErr_SetString(PyExc_ValueError, "list modified during sort");
+        Py_CLEAR(res);
+    }
+
+    if (res != NULL && SubList_store(self, list) < 0)
+        Py_CLEAR(res);
+
+    Py_DECREF(list);
+
+    if (res != NULL)
+        SubList_reordered(self);
+
+    return res;
+}
+
+static PyObject *
+
+SubList_insert(SubListObject *self, PyObject *args)
+{
+    Py_ssize_t i;
+    PyObject *item, *res;
+    int64_t v;
+
+    if (!PyArg_ParseTuple(args, "nO:insert", &i, &item))
+        return NULL;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        if ((res = SubList_delegate(self, "insert", args, NULL)) != NULL)
+            self->version++;
+
+        return res;
+    }
+
+    if (SubList_convert(item, &v) < 0 || SubList_reserve_items(self, 1) < 0)
+        return NULL;
+
+    if (i < 0)
+        i = Py_MAX(i + self->size, 0);
+
+    i = Py_MIN(i, self->size);
+
+    memmove(self->items + i + 1, self->items + i, (self->size - i) * sizeof(int64_t));
+    self->items[i] = v;
+    self->size++;
+    SubList_added_int(self, v);
+
+    Py_RETURN_NONE;
+}
+
+static Py_ssize_t SubList_typed_count(SubListObject *self, PyObject *value, int first);
+static int SubList_ass_item(SubListObject *self, Py_ssize_t i, PyObject *value);
+
+static PyObject *
+
+SubList_remove(SubListObject *self, PyObject *value)
+{
+    Py_ssize_t i;
+
+    if (self->dtype != SUBLIST_OBJECT) {
+        if ((i = SubList_typed_count(self, value, 1)) < 0)
+            return NULL;
+
+        if (i > 0) {
+            if (SubList_ass_item(self, i - 1, NULL) < 0)
+                return NULL;
+
+            Py_RETURN_NONE;
+        }
+
+        PyErr_SetString(PyExc_ValueError, "list.remove(x): x not in list");
+
+        return NULL;
+    }
+
+    for (i = 0; i < PyList_GET_SIZE(self); i++) {
+        PyObject *item = PyList_GET_ITEM(self, i);
+        int eq;
+
+        Py_INCREF(item);
+        eq = PyObject_RichCompareBool(item, value, Py_EQ);
+        Py_DECREF(item);
+
+        if (eq < 0)
+            return NULL;
+
+        if (eq) {
+            if (SubList_ass_item(self, i, NULL) < 0)
+                return NULL;
+
+            Py_RETURN_NONE;
+        }
+    }
+
+    PyErr_SetString(PyExc_ValueError, "list.remove(x): x not in list");
+
+    return NULL;
+}
+
+/*
+ Capacity:
+ A list grows its storage by about an eighth whenever it is full, so building a large list one element at a time reallocates it again and again.
+ reserve(n) makes room for n elements at once, in the list storage or in the typed array, and shrink_to_fit() gives back the room that is not used.
+ list.extend() cuts the storage back to the size of the list when the length of an iterable was overestimated, which would drop a reservation, so a
+ SubList appends and extends its list storage itself, much as list does, but leaves spare room alone; removing elements may still give it back.
+*/
+
+static Py_ssize_t
+
+SubList_capacity(SubListObject *self)
+{
+    return (self->dtype == SUBLIST_OBJECT) ? self->list.allocated : self->allocated;
+}
+
+/* Reallocate the storage in use to exactly allocated elements, which must not be fewer than there are */
+
+static int
+
+SubList_set_capacity(SubListObject *self, Py_ssize_t allocated)
+{
+    size_t itemsize = (self->dtype == SUBLIST_OBJECT) ? sizeof(PyObject *) : sizeof(int64_t);
+    void **storage = (self->dtype == SUBLIST_OBJECT) ? (void **) &self->list.ob_item : (void **) &self->items;
+    void *p = NULL;
+
+    if ((size_t) allocated > PY_SSIZE_T_MAX / itemsize) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    if (allocated == 0)
+        PyMem_Free(*storage);
+    else if ((p = PyMem_Realloc(*storage, allocated * itemsize)) == NULL) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    *storage = p;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        self->list.allocated = allocated;
+    else
+        self->allocated = allocated;
+
+    return 0;
+}
+
+/* Make room for n more elements in the list storage, over-allocating as list does */
+
+static int
+
+SubList_grow_list(SubListObject *self, Py_ssize_t n)
+{
+    Py_ssize_t size = PyList_GET_SIZE(self), allocated;
+
+    if (size + n <= self->list.allocated)
+        return 0;
+
+    if (n > PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(PyObject *) - size) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    allocated = size + n;
+    allocated += Py_MIN(allocated >> 3, PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(PyObject *) - allocated);
+
+    return SubList_set_capacity(self, Py_MIN(allocated + 6, PY_SSIZE_T_MAX / (Py_ssize_t) sizeof(PyObject *)));
+}
+
+/* Append to the list storage, stealing a reference to item */
+
+static int
+
+SubList_push(SubListObject *self, PyObject *item)
+{
+    Py_ssize_t size = PyList_GET_SIZE(self);
+
+    if (size >= self->list.allocated && SubList_grow_list(self, 1) < 0) {
+        Py_DECREF(item);
+
+        return -1;
+    }
+
+    PyList_SET_ITEM(self, size, item);
+    Py_SET_SIZE(self, size + 1);
+
+    return 0;
+}
+
+static int
+
+SubList_extend_list(SubListObject *self, PyObject *iterable)
+{
+    PyObject *it, *item;
+    PyObject *(*iternext)(PyObject *);
+    Py_ssize_t i, n, hint, size = PyList_GET_SIZE(self);
+
+    /* A list or a tuple is copied in one go, after making room for it */
+
+    if (PyList_CheckExact(iterable) || PyTuple_CheckExact(iterable) || iterable == (PyObject *) self) {
+        n = Py_SIZE(iterable);
+
+        if (SubList_grow_list(self, n) < 0)
+            return -1;
+
+        for (i = 0; i < n; i++) {
+            item = PyTuple_Check(iterable) ? PyTuple_GET_ITEM(iterable, i) : PyList_GET_ITEM(iterable, i);
+
+            Py_INCREF(item);
+            PyList_SET_ITEM(self, size + i, item);
+        }
+
+        Py_SET_SIZE(self, size + n);
+
+        return 0;
+    }
+
+    if ((it = PyObject_GetIter(iterable)) == NULL)
+        return -1;
+
+    if ((hint = PyObject_LengthHint(it, 8)) < 0 || SubList_grow_list(self, hint) < 0) {
+        Py_DECREF(it);
+
+        return -1;
+    }
+
+    iternext = *Py_TYPE(it)->tp_iternext;
+
+    while ((item = iternext(it)) != NULL) {
+        if (SubList_push(self, item) < 0) {
+            Py_DECREF(it);
+
+            return -1;
+        }
+    }
+
+    Py_DECREF(it);
+
+    if (PyErr_Occurred() && !PyErr_ExceptionMatches(PyExc_StopIteration))
+        return -1;
+
+    PyErr_Clear();
+
+    return 0;
+}
+
+static PyObject *
+
+SubList_reserve(SubListObject *self, PyObject *arg)
+{
+    Py_ssize_t n = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (n == -1 && PyErr_Occurred())
+        return NULL;
+
+    if (n < 0) {
+        PyErr_SetString(PyExc_ValueError, "reserve() argument must not be negative");
+
+        return NULL;
+    }
+
+    if (n > SubList_capacity(self) && SubList_set_capacity(self, n) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+SubList_shrink_to_fit(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    Py_ssize_t size = (self->dtype == SUBLIST_OBJECT) ? PyList_GET_SIZE(self) : self->size;
+
+    if (size < SubList_capacity(self) && SubList_set_capacity(self, size) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+SubList_copy(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return SubList_tolist(self, NULL);
+}
+
+static PyObject *
+
+SubList_append(SubListObject *self, PyObject *value)
+{
+    int64_t v;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        Py_INCREF(value);
+
+        if (SubList_push(self, value) < 0)
+            return NULL;
+
+        self->version++;
+
+        Py_RETURN_NONE;
+    }
+
+    if (SubList_convert(value, &v) < 0 || SubList_reserve_items(self, 1) < 0)
+        return NULL;
+
+    self->items[self->size++] = v;
+    SubList_added_int(self, v);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+SubList_extend(SubListObject *self, PyObject *iterable)
+{
+    PyObject *it, *item;
+    Py_ssize_t i;
+    int res;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        i = PyList_GET_SIZE(self);
+        res = SubList_extend_list(self, iterable);
+
+        self->version += Py_MAX(PyList_GET_SIZE(self) - i, 0);
+
+        if (res < 0)
+            return NULL;
+
+        Py_RETURN_NONE;
+    }
+
+    if (SubListTyped_Check(iterable)) {
+        SubListObject *other = (SubListObject *) iterable;
+        Py_ssize_t n = other->size;
+
+        if (SubList_reserve_items(self, n) < 0)
+            return NULL;
+
+        if (n > 0)
+            memmove(self->items + self->size, other->items, n * sizeof(int64_t));
+
+        for (i = self->size; i < self->size + n; i++)
+            SubList_added_int(self, self->items[i]);
+
+        self->size += n;
+
+        Py_RETURN_NONE;
+    }
+
+    if ((it = PyObject_GetIter(iterable)) == NULL)
+        return NULL;
+
+    /* As with list.extend(), the elements before one that fails stay appended */
+
+    while ((item = PyIter_Next(it)) != NULL) {
+        int64_t v;
+
+        res = SubList_convert(item, &v);
+        Py_DECREF(item);
+
+        if (res < 0 || SubList_reserve_items(self, 1) < 0) {
+            Py_DECREF(it);
+
+            return NULL;
+        }
+
+        self->items[self->size++] = v;
+        SubList_added_int(self, v);
+    }
+
+    Py_DECREF(it);
+
+    if (PyErr_Occurred())
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+SubList_pop(SubListObject *self, PyObject *args)
+{
+    Py_ssize_t i = -1;
+    PyObject *res;
+    int64_t v;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        if ((res = SubList_delegate(self, "pop", args, NULL)) != NULL)
+            self->version++;
+
+        return res;
+    }
+
+    if (!PyArg_ParseTuple(args, "|n:pop", &i))
+        return NULL;
+
+    if (self->size == 0) {
+        PyErr_SetString(PyExc_IndexError, "pop from empty list");
+
+        return NULL;
+    }
+
+    if (i < 0)
+        i += self->size;
+
+    if (i < 0 || i >= self->size) {
+        PyErr_SetString(PyExc_IndexError, "pop index out of range");
+
+        return NULL;
+    }
+
+    v = self->items[i];
+    memmove(self->items + i, self->items + i + 1, (self->size - i - 1) * sizeof(int64_t));
+    self->size--;
+    SubList_removed_int(self, v);
+
+    return PyLong_FromLongLong(v);
+}
+
+static PyObject *
+
+SubList_clear(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *res = Py_None;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        res = SubList_delegate(self, "clear", NULL, NULL);
+    else {
+        PyMem_Free(self->items);
+        self->items = NULL;
+        self->size = self->allocated = 0;
+
+        Py_INCREF(res);
+    }
+
+    SubList_emptied(self);
+
+    return res;
+}
+
+/*
+ Bulk extend from a buffer:
+ extend_from_buffer(buf, dtype=None) appends the elements of an array.array, a memoryview, or anything else that exports a contiguous buffer of numbers,
+ converting all of them in one pass over the buffer instead of creating, iterating over and appending an object at a time.
+ The elements are read in the format of the buffer, or, given a dtype such as "int32" or "float64", its bytes are read as elements of that type.
+ A TypedSubList stores the numbers in its array directly; floats, or integers that do not fit in an int64_t, raise TypeError or OverflowError, as
+ append() does.
+ Nothing is appended when an element cannot be converted.
+*/
+
+static const struct {
+    const char *name;
+    char code;
+} SubList_dtypes[] = {
+    {"int8", 'b'}, {"uint8", 'B'}, {"int16", 'h'}, {"uint16", 'H'}, {"int32", 'i'}, {"uint32", 'I'},
+    {"int64", 'q'}, {"uint64", 'Q'}, {"float32", 'f'}, {"float64", 'd'}, {"bool", '?'},
+    {NULL},
+};
+
+static Py_ssize_t
+
+SubList_code_size(char code)
+{
+    switch (code) {
+    case 'b': case 'B': case '?': return 1;
+    case 'h': case 'H': return sizeof(short);
+    case 'i': case 'I': return sizeof(int);
+    case 'l': case 'L': return sizeof(long);
+    case 'q': case 'Q': return sizeof(long long);
+    case 'n': case 'N': return sizeof(size_t);
+    case 'f': return sizeof(float);
+    case 'd': return sizeof(double);
+    }
+
+    return 0;
+}
+
+/* Read the i-th element of type type at p into v and run body */
+
+#define SUBLIST_EACH(type, body)                                                    \
+    for (i = 0; i < n; i++) {                                                       \
+        type v;                                                                     \
+                                                                                    \
+        memcpy(&v, p + i * sizeof(type), sizeof(type));                            \
+        body                                                                        \
+    }
+
+/* Returns 1 if an element does not fit in an int64_t */
+
+static int
+
+SubList_convert_ints(int64_t *dst, const char *p, Py_ssize_t n, char code)
+{
+    Py_ssize_t i;
+
+    switch (code) {
+    case 'b': SUBLIST_EACH(signed char, dst[i] = v;) break;
+    case 'B': SUBLIST_EACH(unsigned char, dst[i] = v;) break;
+    case '?': SUBLIST_EACH(unsigned char, dst[i] = v != 0;) break;
+    case 'h': SUBLIST_EACH(short, dst[i] = v;) break;
+    case 'H': SUBLIST_EACH(unsigned short, dst[i] = v;) break;
+    case 'i': SUBLIST_EACH(int, dst[i] = v;) break;
+    case 'I': SUBLIST_EACH(unsigned int, dst[i] = v;) break;
+    case 'l': SUBLIST_EACH(long, dst[i] = v;) break;
+    case 'q': SUBLIST_EACH(long long, dst[i] = v;) break;
+    case 'n': SUBLIST_EACH(Py_ssize_t, dst[i] = v;) break;
+    case 'L': SUBLIST_EACH(unsigned long, if (v > INT64_MAX) goto overflow; dst[i] = (int64_t) v;) break;
+    case 'Q': SUBLIST_EACH(unsigned long long, if (v > INT64_MAX) goto overflow; dst[i] = (int64_t) v;) break;
+    case 'N': SUBLIST_EACH(size_t, if (v > INT64_MAX) goto overflow; dst[i] = (int64_t) v;) break;
+    default:
+        return 1;
+    }
+
+    return 0;
+
+overflow:
+    return 1;
+}
+
+static int
+
+SubList_convert_objects(PyObject **dst, const char *p, Py_ssize_t n, char code)
+{
+    Py_ssize_t i;
+
+    switch (code) {
+    case 'b': SUBLIST_EACH(signed char, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case 'B': SUBLIST_EACH(unsigned char, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case '?': SUBLIST_EACH(unsigned char, dst[i] = PyBool_FromLong(v);) break;
+    case 'h': SUBLIST_EACH(short, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case 'H': SUBLIST_EACH(unsigned short, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case 'i': SUBLIST_EACH(int, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case 'I': SUBLIST_EACH(unsigned int, if ((dst[i] = PyLong_FromUnsignedLong(v)) == NULL) goto error;) break;
+    case 'l': SUBLIST_EACH(long, if ((dst[i] = PyLong_FromLong(v)) == NULL) goto error;) break;
+    case 'L': SUBLIST_EACH(unsigned long, if ((dst[i] = PyLong_FromUnsignedLong(v)) == NULL) goto error;) break;
+    case 'q': SUBLIST_EACH(long long, if ((dst[i] = PyLong_FromLongLong(v)) == NULL) goto error;) break;
+    case 'Q': SUBLIST_EACH(unsigned long long, if ((dst[i] = PyLong_FromUnsignedLongLong(v)) == NULL) goto error;) break;
+    case 'n': SUBLIST_EACH(Py_ssize_t, if ((dst[i] = PyLong_FromSsize_t(v)) == NULL) goto error;) break;
+    case 'N': SUBLIST_EACH(size_t, if ((dst[i] = PyLong_FromSize_t(v)) == NULL) goto error;) break;
+    case 'f': SUBLIST_EACH(float, if ((dst[i] = PyFloat_FromDouble(v)) == NULL) goto error;) break;
+    case 'd': SUBLIST_EACH(double, if ((dst[i] = PyFloat_FromDouble(v)) == NULL) goto error;) break;
+    }
+
+    return 0;
+
+error:
+    while (i-- > 0)
+        Py_DECREF(dst[i]);
+
+    return -1;
+}
+
+static PyObject *
+
+SubList_extend_from_buffer(SubListObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"buf", "dtype", NULL};
+
+    PyObject *obj;
+    const char *dtype = NULL, *format;
+    Py_buffer view;
+    Py_ssize_t i, n, size, start;
+    char code;
+    int res = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|z:extend_from_buffer", kwlist, &obj, &dtype))
+        return NULL;
+
+    if (PyObject_GetBuffer(obj, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+
+    if (dtype != NULL) {
+        for (i = 0; SubList_dtypes[i].name != NULL && strcmp(SubList_dtypes[i].name, dtype) != 0; i++)
+            ;
+
+        code = SubList_dtypes[i].code;
+        size = SubList_code_size(code);
+
+        if (SubList_dtypes[i].name == NULL) {
+            PyErr_Format(PyExc_ValueError, "unsupported dtype '%s'", dtype);
+            PyBuffer_Release(&view);
+
+            return NULL;
+        }
+    }
+    else {
+        format = (view.format != NULL) ? view.format : "B";
+        format += (format[0] == '@');
+        code = format[0];
+        size = SubList_code_size(code);
+
+        if (size == 0 || format[1] != '\0' || size != view.itemsize) {
+            PyErr_Format(PyExc_ValueError, "unsupported buffer format '%s'", view.format);
+            PyBuffer_Release(&view);
+
+            return NULL;
+        }
+    }
+
+    if (view.len % size != 0) {
+        PyErr_Format(PyExc_ValueError, "buffer size %zd is not a multiple of the element size %zd", view.len, size);
+        PyBuffer_Release(&view);
+
+        return NULL;
+    }
+
+    n = view.len / size;
+
+    /* The elements are converted into the spare room of the storage and counted in once all of them are */
+
+    if (self->dtype == SUBLIST_INT64) {
+        start = self->size;
+        res = SubList_reserve_items(self, n);
+
+        if (res == 0 && (res = SubList_convert_ints(self->items + start, view.buf, n, code)) == 0) {
+            self->size += n;
+
+            for (i = start; i < self->size; i++)
+                SubList_added_int(self, self->items[i]);
+        }
+
+        if (res > 0 && (code == 'f' || code == 'd'))
+            PyErr_SetString(PyExc_TypeError, "TypedSubList elements must be int, not float");
+        else if (res > 0)
+            PyErr_SetString(PyExc_OverflowError, "buffer element does not fit in int64");
+    }
+    else {
+        start = PyList_GET_SIZE(self);
+        res = SubList_grow_list(self, n);
+
+        if (res == 0 && (res = SubList_convert_objects(self->list.ob_item + start, view.buf, n, code)) == 0) {
+            Py_SET_SIZE(self, start + n);
+            self->version += n;
+        }
+    }
+
+    PyBuffer_Release(&view);
+
+    if (res != 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+/* Count the typed elements equal to value, or, if first is set, return one more than the index of the first one, or 0 if there is none */
+
+static Py_ssize_t
+
+SubList_typed_count(SubListObject *self, PyObject *value, int first)
+{
+    Py_ssize_t i, count = 0;
+
+    if (PyLong_CheckExact(value) || PyBool_Check(value)) {
+        int overflow;
+        long long v = PyLong_AsLongLongAndOverflow(value, &overflow);
+
+        if (v == -1 && PyErr_Occurred())
+            return -1;
+
+        if (overflow)
+            return 0;
+
+        if (first) {
+            for (i = 0; i < self->size; i++) {
+                if (self->items[i] == v)
+                    return i + 1;
+            }
+
+            return 0;
+        }
+
+        for (i = 0; i < self->size; i++)
+            count += self->items[i] == v;
+
+        return count;
+    }
+
+    /* Anything else may still compare equal to an int, as 1.0 does */
+
+    for (i = 0; i < self->size; i++) {
+        PyObject *item = PyLong_FromLongLong(self->items[i]);
+        int eq;
+
+        if (item == NULL)
+            return -1;
+
+        eq = PyObject_RichCompareBool(item, value, Py_EQ);
+        Py_DECREF(item);
+
+        if (eq < 0)
+            return -1;
+
+        if (eq && first)
+            return i + 1;
+
+        count += eq;
+    }
+
+    return count;
+}
+
+static PyObject *
+
+SubList_count(SubListObject *self, PyObject *value)
+{
+    Py_ssize_t count;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return SubList_delegate1(self, "count", value);
+
+    count = SubList_typed_count(self, value, 0);
+
+    return (count < 0) ? NULL : PyLong_FromSsize_t(count);
+}
+
+/* Call a built-in function on an object mode SubList */
+
+static PyObject *
+
+SubList_builtin(SubListObject *self, const char *name)
+{
+    PyObject *func = PyDict_GetItemString(PyEval_GetBuiltins(), name);
+
+    if (func == NULL) {
+        PyErr_Format(PyExc_RuntimeError, "built-in %s() not found", name);
+
+        return NULL;
+    }
+
+    return PyObject_CallFunctionObjArgs(func, (PyObject *) self, NULL);
+}
+
+/* Recompute the aggregates that are invalid */
+
+static void
+
+SubList_recount_sum(SubListObject *self)
+{
+    uint64_t hi = 0, lo = 0;
+    Py_ssize_t i;
+
+    for (i = 0; i < self->size; i++) {
+        uint64_t u = (uint64_t) self->items[i];
+
+        lo += u;
+        hi += ((self->items[i] < 0) ? UINT64_MAX : 0) + (lo < u);
+    }
+
+    self->sum_hi = hi;
+    self->sum_lo = lo;
+    self->sum_valid = 1;
+}
+
+static void
+
+SubList_recount_minmax(SubListObject *self)
+{
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    Py_ssize_t i;
+
+    for (i = 0; i < self->size; i++) {
+        min = (self->items[i] < min) ? self->items[i] : min;
+        max = (self->items[i] > max) ? self->items[i] : max;
+    }
+
+    self->min = min;
+    self->max = max;
+    self->minmax_valid = 1;
+}
+
+/*
+ The sum is accumulated as the sums of the high and the low 32 bits of the elements, which cannot overflow for fewer than 2**31 elements; the loop has no
+ dependency but the additions, so it vectorizes, and the two parts are combined into an int of any size at the end.
+*/
+
+#define SUBLIST_SUM_BLOCK ((Py_ssize_t) 1 << 30)
+
+static PyObject *
+
+SubList_sum(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *total;
+    Py_ssize_t start;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return SubList_builtin(self, "sum");
+
+    if (self->aggregates) {
+        if (!self->sum_valid)
+            SubList_recount_sum(self);
+
+        return SubList_int128(self->sum_hi, self->sum_lo);
+    }
+
+    total = PyLong_FromLong(0);
+
+    for (start = 0; total != NULL && start < self->size; start += SUBLIST_SUM_BLOCK) {
+        const int64_t *items = self->items + start;
+        Py_ssize_t i, n = Py_MIN(SUBLIST_SUM_BLOCK, self->size - start);
+        int64_t hi = 0;
+        uint64_t lo = 0;
+        PyObject *h, *l, *shift, *part = NULL;
+
+        for (i = 0; i < n; i++) {
+            hi += items[i] >> 32;
+            lo += (uint32_t) items[i];
+        }
+
+        h = PyLong_FromLongLong(hi);
+        l = PyLong_FromUnsignedLongLong(lo);
+        shift = PyLong_FromLong(32);
+
+        if (h != NULL && l != NULL && shift != NULL) {
+            Py_SETREF(h, PyNumber_Lshift(h, shift));
+
+            if (h != NULL)
+                part = PyNumber_Add(h, l);
+        }
+
+        Py_XDECREF(h);
+        Py_XDECREF(l);
+        Py_XDECREF(shift);
+
+        Py_SETREF(total, part ? PyNumber_Add(total, part) : NULL);
+        Py_XDECREF(part);
+    }
+
+    return total;
+}
+
+static PyObject *
+
+SubList_minmax(SubListObject *self, int want_max)
+{
+    const int64_t *items = self->items;
+    Py_ssize_t i;
+    int64_t best;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return SubList_builtin(self, want_max ? "max" : "min");
+
+    if (self->size == 0) {
+        PyErr_Format(PyExc_ValueError, "%s() arg is an empty sequence", want_max ? "max" : "min");
+
+        return NULL;
+    }
+
+    if (self->aggregates) {
+        if (!self->minmax_valid)
+            SubList_recount_minmax(self);
+
+        return PyLong_FromLongLong(want_max ? self->max : self->min);
+    }
+
+    best = items[0];
+
+    if (want_max) {
+        for (i = 1; i < self->size; i++)
+            best = (items[i] > best) ? items[i] : best;
+    }
+    else {
+        for (i = 1; i < self->size; i++)
+            best = (items[i] < best) ? items[i] : best;
+    }
+
+    return PyLong_FromLongLong(best);
+}
+
+static PyObject *
+
+SubList_min(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return SubList_minmax(self, 0);
+}
+
+static PyObject *
+
+SubList_max(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return SubList_minmax(self, 1);
+}
+
+/* Sequence and mapping slots; in object mode they are those of list */
+
+static Py_ssize_t
+
+SubList_length(SubListObject *self)
+{
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_as_sequence->sq_length((PyObject *) self);
+
+    return self->size;
+}
+
+static PyObject *
+
+SubList_item(SubListObject *self, Py_ssize_t i)
+{
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_as_sequence->sq_item((PyObject *) self, i);
+
+    if (i < 0 || i >= self->size) {
+        PyErr_SetString(PyExc_IndexError, "list index out of range");
+
+        return NULL;
+    }
+
+    return PyLong_FromLongLong(self->items[i]);
+}
+
+static int
+
+SubList_ass_item(SubListObject *self, Py_ssize_t i, PyObject *value)
+{
+    int64_t v;
+
+    if (i < 0 || i >= SubList_length(self)) {
+        PyErr_SetString(PyExc_IndexError, "list assignment index out of range");
+
+        return -1;
+    }
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        if (PyList_Type.tp_as_sequence->sq_ass_item((PyObject *) self, i, value) < 0)
+            return -1;
+
+        self->version++;
+
+        return 0;
+    }
+
+    if (value == NULL) {
+        v = self->items[i];
+        memmove(self->items + i, self->items + i + 1, (self->size - i - 1) * sizeof(int64_t));
+        self->size--;
+        SubList_removed_int(self, v);
+
+        return 0;
+    }
+
+    if (SubList_convert(value, &v) < 0)
+        return -1;
+
+    SubList_removed_int(self, self->items[i]);
+    self->items[i] = v;
+    SubList_added_int(self, v);
+
+    return 0;
+}
+
+static int
+
+SubList_contains(SubListObject *self, PyObject *value)
+{
+    Py_ssize_t found;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_as_sequence->sq_contains((PyObject *) self, value);
+
+    found = SubList_typed_count(self, value, 1);
+
+    return (found < 0) ? -1 : (found > 0);
+}
+
+static PyObject *
+
+SubList_subscript(SubListObject *self, PyObject *key)
+{
+    Py_ssize_t start, stop, step, n, i;
+    PyObject *list;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_as_mapping->mp_subscript((PyObject *) self, key);
+
+    if (PyIndex_Check(key)) {
+        i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+
+        if (i == -1 && PyErr_Occurred())
+            return NULL;
+
+        return SubList_item(self, (i < 0) ? i + self->size : i);
+    }
+
+    if (!PySlice_Check(key)) {
+        PyErr_Format(PyExc_TypeError, "list indices must be integers or slices, not %.200s", Py_TYPE(key)->tp_name);
+
+        return NULL;
+    }
+
+    /* Like any slice of a list, the result is an ordinary list */
+
+    if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+        return NULL;
+
+    n = PySlice_AdjustIndices(self->size, &start, &stop, step);
+
+    if ((list = PyList_New(n)) == NULL)
+        return NULL;
+
+    for (i = 0; i < n; i++, start += step) {
+        PyObject *item = PyLong_FromLongLong(self->items[start]);
+
+        if (item == NULL) {
+            Py_DECREF(list);
+
+            return NULL;
+        }
+
+        PyList_SET_ITEM(list, i, item);
+    }
+
+    return list;
+}
+
+static int
+
+SubList_ass_subscript(SubListObject *self, PyObject *key, PyObject *value)
+{
+    if (PyIndex_Check(key)) {
+        Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+
+        if (i == -1 && PyErr_Occurred())
+            return -1;
+
+        return SubList_ass_item(self, (i < 0) ? i + SubList_length(self) : i, value);
+    }
+
+    /* A slice of a TypedSubList is assigned on a temporary list, and the elements are stored back only if all of them can be */
+
+    if (self->dtype != SUBLIST_OBJECT) {
+        PyObject *list = SubList_tolist(self, NULL);
+        int res;
+
+        if (list == NULL)
+            return -1;
+
+        res = PyList_Type.tp_as_mapping->mp_ass_subscript(list, key, value);
+
+        if (res == 0)
+            res = SubList_store(self, list);
+
+        Py_DECREF(list);
+
+        if (res == 0)
+            SubList_changed(self);
+
+        return res;
+    }
+
+    SubList_changed(self);
+
+    return PyList_Type.tp_as_mapping->mp_ass_subscript((PyObject *) self, key, value);
+}
+
+/*
+ list implements + and * through sq_concat and sq_repeat of the left operand, which only accept a list on the right.
+ The number slots are tried before those, on either side, so both types handle + and * there, and a TypedSubList on either side acts as a list.
+*/
+
+static PyObject *
+
+SubList_add(PyObject *a, PyObject *b)
+{
+    PyObject *x, *y, *res = NULL;
+
+    if (!PyList_Check(a) && !SubListTyped_Check(a))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    if (!PyList_Check(b) && !SubListTyped_Check(b))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    x = SubList_as_list(a);
+    y = SubList_as_list(b);
+
+    if (x != NULL && y != NULL)
+        res = PySequence_Concat(x, y);
+
+    Py_XDECREF(x);
+    Py_XDECREF(y);
+
+    return res;
+}
+
+static PyObject *
+
+SubList_multiply(PyObject *a, PyObject *b)
+{
+    PyObject *seq = SubList_Check(a) ? a : b, *count = (seq == a) ? b : a, *list, *res;
+    Py_ssize_t n;
+
+    if (!PyIndex_Check(count))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    n = PyNumber_AsSsize_t(count, PyExc_OverflowError);
+
+    if (n == -1 && PyErr_Occurred())
+        return NULL;
+
+    if ((list = SubList_as_list(seq)) == NULL)
+        return NULL;
+
+    res = PySequence_Repeat(list, n);
+    Py_DECREF(list);
+
+    return res;
+}
+
+static PyObject *
+
+SubList_inplace_add(SubListObject *self, PyObject *other)
+{
+    PyObject *res;
+
+    if ((res = SubList_extend(self, other)) == NULL)
+        return NULL;
+
+    Py_DECREF(res);
+    Py_INCREF(self);
+
+    return (PyObject *) self;
+}
+
+static PyObject *
+
+SubList_inplace_multiply(SubListObject *self, PyObject *count)
+{
+    Py_ssize_t n, size = self->size, i;
+
+    if (!PyIndex_Check(count))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    n = PyNumber_AsSsize_t(count, PyExc_OverflowError);
+
+    if (n == -1 && PyErr_Occurred())
+        return NULL;
+
+    if (self->dtype == SUBLIST_OBJECT) {
+        PyObject *res = PyList_Type.tp_as_sequence->sq_inplace_repeat((PyObject *) self, n);
+
+        if (res != NULL && n <= 0)
+            SubList_emptied(self);
+        else if (res != NULL)
+            SubList_repeated(self, n);
+
+        return res;
+    }
+
+    if (n <= 0 || size == 0) {
+        self->size = 0;
+        SubList_emptied(self);
+    }
+    else {
+        if (size > PY_SSIZE_T_MAX / n || SubList_reserve_items(self, size * (n - 1)) < 0)
+            return PyErr_NoMemory();
+
+        for (i = 1; i < n; i++)
+            memcpy(self->items + i * size, self->items, size * sizeof(int64_t));
+
+        self->size = size * n;
+        SubList_repeated(self, n);
+    }
+
+    Py_INCREF(self);
+
+    return (PyObject *) self;
+}
+
+static PyObject *
+
+SubList_richcompare(PyObject *a, PyObject *b, int op)
+{
+    PyObject *x, *y, *res = NULL;
+
+    if (((SubListObject *) a)->dtype == SUBLIST_OBJECT && !SubListTyped_Check(b))
+        return PyList_Type.tp_richcompare(a, b, op);
+
+    x = SubList_as_list(a);
+    y = SubList_as_list(b);
+
+    if (x != NULL && y != NULL)
+        res = PyObject_RichCompare(x, y, op);
+
+    Py_XDECREF(x);
+    Py_XDECREF(y);
+
+    return res;
+}
+
+static PyObject *
+
+SubList_repr(SubListObject *self)
+{
+    PyObject *list, *res;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_repr((PyObject *) self);
+
+    if ((list = SubList_tolist(self, NULL)) == NULL)
+        return NULL;
+
+    res = PyObject_Repr(list);
+    Py_DECREF(list);
+
+    return res;
+}
+
+/* The iterator of a TypedSubList */
 
 typedef struct {
-    PyListObject list;
-    int state;
-} SubListObject;
+    PyObject_HEAD
+    SubListObject *seq;
+    Py_ssize_t index;
+} SubListIterObject;
+
+static void
+
+SubListIter_dealloc(SubListIterObject *it)
+{
+    PyObject_GC_UnTrack(it);
+    Py_XDECREF(it->seq);
+    PyObject_GC_Del(it);
+}
+
+static int
+
+SubListIter_traverse(SubListIterObject *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->seq);
+
+    return 0;
+}
 
 static PyObject *
 
-SubList_increment(SubListObject *self, PyObject *unused)
+SubListIter_next(SubListIterObject *it)
+{
+    SubListObject *seq = it->seq;
+
+    if (seq == NULL)
+        return NULL;
+
+    if (it->index < seq->size)
+        return PyLong_FromLongLong(seq->items[it->index++]);
+
+    Py_CLEAR(it->seq);
+
+    return NULL;
+}
+
+static PyTypeObject SubListIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sublist.SubListIterator",
+    .tp_basicsize = sizeof(SubListIterObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_dealloc = (destructor) SubListIter_dealloc,
+    .tp_traverse = (traverseproc) SubListIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc) SubListIter_next,
+};
+
+static PyObject *
+
+SubList_iter(SubListObject *self)
 {
-    self->state++;
+    SubListIterObject *it;
+
+    if (self->dtype == SUBLIST_OBJECT)
+        return PyList_Type.tp_iter((PyObject *) self);
+
+    it = PyObject_GC_New(SubListIterObject, &SubListIterType);
+
+    if (it == NULL)
+        return NULL;
 
-    return PyLong_FromLong(self->state);
+    Py_INCREF(self);
+    it->seq = self;
+    it->index = 0;
 
+    PyObject_GC_Track(it);
+
+    return (PyObject *) it;
 }
 
+/* The methods of both types; TypedSubList adds __reduce__ */
+
+#define SUBLIST_METHODS                                                                                                 \
+    {"increment", (PyCFunction) SubList_increment, METH_NOARGS,                                                         \
+     PyDoc_STR("increment state counter on the shard of this thread, and return it")},                                  \
+    {"tolist", (PyCFunction) SubList_tolist, METH_NOARGS,                                                               \
+     PyDoc_STR("return an ordinary list with the elements")},                                                           \
+    {"sum", (PyCFunction) SubList_sum, METH_NOARGS,                                                                     \
+     PyDoc_STR("return the sum of the elements")},                                                                      \
+    {"min", (PyCFunction) SubList_min, METH_NOARGS,                                                                     \
+     PyDoc_STR("return the smallest element")},                                                                         \
+    {"max", (PyCFunction) SubList_max, METH_NOARGS,                                                                     \
+     PyDoc_STR("return the largest element")},                                                                          \
+    {"count", (PyCFunction) SubList_count, METH_O,                                                                      \
+     PyDoc_STR("return number of occurrences of value")},                                                               \
+    {"append", (PyCFunction) SubList_append, METH_O,                                                                    \
+     PyDoc_STR("append object to the end of the list")},                                                                \
+    {"extend", (PyCFunction) SubList_extend, METH_O,                                                                    \
+     PyDoc_STR("extend list by appending elements from the iterable")},                                                 \
+    {"pop", (PyCFunction) SubList_pop, METH_VARARGS,                                                                    \
+     PyDoc_STR("remove and return item at index (default last)")},                                                      \
+    {"clear", (PyCFunction) SubList_clear, METH_NOARGS,                                                                 \
+     PyDoc_STR("remove all items from list")},                                                                          \
+    {"reserve", (PyCFunction) SubList_reserve, METH_O,                                                                  \
+     PyDoc_STR("make room for n elements in all")},                                                                     \
+    {"shrink_to_fit", (PyCFunction) SubList_shrink_to_fit, METH_NOARGS,                                                 \
+     PyDoc_STR("free the room that is not used by elements")},                                                          \
+    {"extend_from_buffer", (PyCFunction)(void(*)(void)) SubList_extend_from_buffer, METH_VARARGS | METH_KEYWORDS,       \
+     PyDoc_STR("extend list by the numbers in a buffer, read as dtype if given")},                                      \
+    {"copy", (PyCFunction) SubList_copy, METH_NOARGS,                                                                   \
+     PyDoc_STR("return a shallow copy of the list")},                                                                   \
+    {"insert", (PyCFunction) SubList_insert, METH_VARARGS,                                                              \
+     PyDoc_STR("insert object before index")},                                                                          \
+    {"remove", (PyCFunction) SubList_remove, METH_O,                                                                    \
+     PyDoc_STR("remove first occurrence of value")},                                                                    \
+    {"reverse", (PyCFunction) SubList_reverse, METH_NOARGS,                                                             \
+     PyDoc_STR("reverse *IN PLACE*")},                                                                                  \
+    {"sort", (PyCFunction)(void(*)(void)) SubList_sort, METH_VARARGS | METH_KEYWORDS,                                   \
+     PyDoc_STR("sort the list in ascending order and return None")},                                                    \
+    {"index", (PyCFunction)(void(*)(void)) SubList_index, METH_VARARGS | METH_KEYWORDS,                                 \
+     PyDoc_STR("return first index of value")},                                                                         \
+    {"__reversed__", (PyCFunction)(void(*)(void)) SubList___reversed__, METH_VARARGS | METH_KEYWORDS,                   \
+     PyDoc_STR("return a reverse iterator over the list")},
+
 static PyMethodDef SubList_methods[] = {
-    {"increment", (PyCFunction) SubList_increment, METH_NOARGS,
-     PyDoc_STR("increment state counter")},
+    SUBLIST_METHODS
     {NULL},
 };
 
@@ -58,14 +1983,149 @@ static int
 
 SubList_init(SubListObject *self, PyObject *args, PyObject *kwds)
 {
-    if (PyList_Type.tp_init((PyObject *) self, args, kwds) < 0)
+    static char *kwlist[] = {"", "dtype", "aggregates", NULL};
+
+    PyObject *iterable = NULL, *listargs;
+    const char *dtype = NULL;
+    int result, aggregates = 0, mode = SUBLIST_OBJECT;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$zp:SubList", kwlist, &iterable, &dtype, &aggregates))
+        return -1;
+
+    if (dtype != NULL && strcmp(dtype, "int64") == 0)
+        mode = SUBLIST_INT64;
+    else if (dtype != NULL && strcmp(dtype, "object") != 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', expected 'object' or 'int64'", dtype);
+
         return -1;
+    }
 
-    self->state = 0;
+    /* SubList_new() has turned SubList(dtype="int64") into a TypedSubList already */
+
+    if (mode == SUBLIST_INT64) {
+        PyErr_SetString(PyExc_TypeError, "dtype 'int64' only applies when a SubList is created");
+
+        return -1;
+    }
+
+    if (aggregates) {
+        PyErr_SetString(PyExc_ValueError, "aggregates=True requires dtype='int64'");
+
+        return -1;
+    }
+
+    /* list.__init__() empties the list storage and fills it */
+
+    listargs = (iterable != NULL) ? PyTuple_Pack(1, iterable) : PyTuple_New(0);
+
+    if (listargs == NULL)
+        return -1;
+
+    result = PyList_Type.tp_init((PyObject *) self, listargs, NULL);
+    Py_DECREF(listargs);
+
+    if (result < 0)
+        return -1;
+
+    SubList_emptied(self);
+    SubList_reset_state(self);
 
     return 0;
 }
 
+/*
+ SubList(iterable, dtype="int64") creates a TypedSubList.
+ type.__call__() only runs tp_init for an instance of the type that was called, so the TypedSubList is initialized here, by calling its type.
+*/
+
+static PyObject *
+
+SubList_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *dtype = (kwds != NULL) ? PyDict_GetItemString(kwds, "dtype") : NULL;
+
+    if (dtype == NULL || !PyUnicode_Check(dtype) || PyUnicode_CompareWithASCIIString(dtype, "int64") != 0)
+        return PyList_Type.tp_new(type, args, kwds);
+
+    if (type != &SubListType) {
+        PyErr_Format(PyExc_TypeError, "dtype 'int64' is only supported by SubList itself, not by %.100s", type->tp_name);
+
+        return NULL;
+    }
+
+    return PyObject_Call((PyObject *) &SubListTypedType, args, kwds);
+}
+
+static PyObject *
+
+SubList_get_state(SubListObject *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(SubList_state(self));
+}
+
+static PyObject *
+
+SubList_get_version(SubListObject *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->version);
+}
+
+static PyObject *
+
+SubList_get_aggregates(SubListObject *self, void *closure)
+{
+    return PyBool_FromLong(self->aggregates);
+}
+
+static PyObject *
+
+SubList_get_capacity(SubListObject *self, void *closure)
+{
+    return PyLong_FromSsize_t(SubList_capacity(self));
+}
+
+static PyGetSetDef SubList_getsetters[] = {
+    {"state", (getter) SubList_get_state, NULL,
+     "number of calls of increment() since the list was initialized", NULL},
+    {"capacity", (getter) SubList_get_capacity, NULL,
+     "number of elements there is room for", NULL},
+    {"version", (getter) SubList_get_version, NULL,
+     "number of changes made to the list", NULL},
+    {"aggregates", (getter) SubList_get_aggregates, NULL,
+     "whether sum(), min() and max() are kept up to date", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static void
+
+SubList_dealloc(SubListObject *self)
+{
+    PyMem_Free(self->items);
+    PyMem_Free(self->shards);
+
+    PyList_Type.tp_dealloc((PyObject *) self);
+}
+
+static PySequenceMethods SubList_as_sequence = {
+    .sq_length = (lenfunc) SubList_length,
+    .sq_item = (ssizeargfunc) SubList_item,
+    .sq_ass_item = (ssizeobjargproc) SubList_ass_item,
+    .sq_contains = (objobjproc) SubList_contains,
+};
+
+static PyMappingMethods SubList_as_mapping = {
+    .mp_length = (lenfunc) SubList_length,
+    .mp_subscript = (binaryfunc) SubList_subscript,
+    .mp_ass_subscript = (objobjargproc) SubList_ass_subscript,
+};
+
+static PyNumberMethods SubList_as_number = {
+    .nb_add = SubList_add,
+    .nb_multiply = SubList_multiply,
+    .nb_inplace_add = (binaryfunc) SubList_inplace_add,
+    .nb_inplace_multiply = (binaryfunc) SubList_inplace_multiply,
+};
+
 static PyTypeObject SubListType = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "sublist.SubList",
@@ -73,8 +2133,120 @@ static PyTypeObject SubListType = {
     .tp_basicsize = sizeof(SubListObject),
     .tp_itemsize = 0,
     .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_new = SubList_new,
     .tp_init = (initproc) SubList_init,
+    .tp_dealloc = (destructor) SubList_dealloc,
+    .tp_repr = (reprfunc) SubList_repr,
+    .tp_richcompare = SubList_richcompare,
+    .tp_iter = (getiterfunc) SubList_iter,
+    .tp_as_number = &SubList_as_number,
+    .tp_as_sequence = &SubList_as_sequence,
+    .tp_as_mapping = &SubList_as_mapping,
     .tp_methods = SubList_methods,
+    .tp_getset = SubList_getsetters,
+};
+
+/* The TypedSubList type; it holds no references, so it needs no GC support */
+
+static PyObject *
+
+SubList_typed_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    SubListObject *self = (SubListObject *) type->tp_alloc(type, 0);
+
+    if (self != NULL)
+        self->dtype = SUBLIST_INT64;
+
+    return (PyObject *) self;
+}
+
+static int
+
+SubList_typed_init(SubListObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"", "dtype", "aggregates", NULL};
+
+    PyObject *iterable = NULL, *res;
+    const char *dtype = NULL;
+    int aggregates = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Ozp:TypedSubList", kwlist, &iterable, &dtype, &aggregates))
+        return -1;
+
+    if (dtype != NULL && strcmp(dtype, "int64") != 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', expected 'int64'", dtype);
+
+        return -1;
+    }
+
+    /* As list.__init__() does, start over from an empty list; the elements are counted into the aggregates as they are added */
+
+    self->size = 0;
+    self->aggregates = aggregates;
+    SubList_emptied(self);
+
+    if (iterable != NULL) {
+        if ((res = SubList_extend(self, iterable)) == NULL)
+            return -1;
+
+        Py_DECREF(res);
+    }
+
+    SubList_reset_state(self);
+
+    return 0;
+}
+
+static void
+
+SubList_typed_dealloc(SubListObject *self)
+{
+    PyMem_Free(self->items);
+    PyMem_Free(self->shards);
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* Pickled as TypedSubList((), "int64", aggregates), extended by the elements */
+
+static PyObject *
+
+SubList_typed_reduce(SubListObject *self, PyObject *Py_UNUSED(ignored))
+{
+    PyObject *it = PyObject_GetIter((PyObject *) self);
+
+    if (it == NULL)
+        return NULL;
+
+    return Py_BuildValue("O(()sO)ON", (PyObject *) Py_TYPE(self), "int64", self->aggregates ? Py_True : Py_False, Py_None, it);
+}
+
+static PyMethodDef SubList_typed_methods[] = {
+    SUBLIST_METHODS
+    {"__reduce__", (PyCFunction) SubList_typed_reduce, METH_NOARGS,
+     PyDoc_STR("return state information for pickling")},
+    {NULL},
+};
+
+static PyTypeObject SubListTypedType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sublist.TypedSubList",
+    .tp_doc = "SubList-like sequences that keep int64 elements in a typed array",
+    .tp_basicsize = sizeof(SubListObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_SEQUENCE,
+    .tp_new = SubList_typed_new,
+    .tp_init = (initproc) SubList_typed_init,
+    .tp_dealloc = (destructor) SubList_typed_dealloc,
+    .tp_repr = (reprfunc) SubList_repr,
+    .tp_hash = PyObject_HashNotImplemented,
+    .tp_richcompare = SubList_richcompare,
+    .tp_iter = (getiterfunc) SubList_iter,
+    .tp_as_number = &SubList_as_number,
+    .tp_as_sequence = &SubList_as_sequence,
+    .tp_as_mapping = &SubList_as_mapping,
+    .tp_methods = SubList_typed_methods,
+    .tp_getset = SubList_getsetters,
 };
 
 static PyModuleDef sublistmodule = {
@@ -93,14 +2265,22 @@ PyInit_sublist(void)
     if (PyType_Ready(&SubListType) < 0)
         return NULL;
 
+    if (PyType_Ready(&SubListTypedType) < 0)
+        return NULL;
+
+    if (PyType_Ready(&SubListIterType) < 0)
+        return NULL;
+
     m = PyModule_Create(&sublistmodule);
 
     if (m == NULL)
         return NULL;
 
     Py_INCREF(&SubListType);
+    Py_INCREF(&SubListTypedType);
 
     PyModule_AddObject(m, "SubList", (PyObject *) &SubListType);
+    PyModule_AddObject(m, "TypedSubList", (PyObject *) &SubListTypedType);
 
     return m;
 }
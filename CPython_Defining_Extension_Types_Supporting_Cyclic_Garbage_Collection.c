@@ -33,12 +33,31 @@
 #include <Python.h>
 #include "structmember.h"
 
+/* Build with -DCUSTOM_CACHE_NAME=0 to format the name on every call of Custom.name() */
+
+#ifndef CUSTOM_CACHE_NAME
+#define CUSTOM_CACHE_NAME 1
+#endif
+
+#define CUSTOM_INLINE_TEXT ((2 + CUSTOM_CACHE_NAME) * sizeof(PyObject *))
+
 typedef struct {
     PyObject_HEAD
-    PyObject *first; /* first name */
-    PyObject *last;  /* last name */
-
+    union {
+        struct {
+            PyObject *first; /* first name */
+            PyObject *last;  /* last name */
+#if CUSTOM_CACHE_NAME
+            PyObject *name;  /* cached result of name(), or NULL */
+#endif
+        };
+        char text[CUSTOM_INLINE_TEXT];  /* UTF-8 of both names while inlined, see Custom_materialize() */
+    };
+
+    Py_hash_t names_hash;               /* cached part of the hash, or 0; see Custom_hash() */
     int number;
+    unsigned char inlined;              /* text holds the names, the pointers are not valid */
+    unsigned char first_size, last_size;
 
 } CustomObject;
 
@@ -46,19 +65,422 @@ static int
 
 Custom_traverse(CustomObject *self, visitproc visit, void *arg)
 {
+    if (self->inlined)
+        return 0;
+
     Py_VISIT(self->first);
     Py_VISIT(self->last);
+#if CUSTOM_CACHE_NAME
+    Py_VISIT(self->name);
+#endif
 
     return 0;
 
 }
 
+/* Drop the cached name and hash after first or last has changed */
+
+#if CUSTOM_CACHE_NAME
+#define Custom_INVALIDATE(self) do { Py_CLEAR((self)->name); (self)->names_hash = 0; } while (0)
+#else
+#define Custom_INVALIDATE(self) ((void) ((self)->names_hash = 0))
+#endif
+
 static int
 
 Custom_clear(CustomObject *self)
 {
+    if (self->inlined)
+        return 0;
+
     Py_CLEAR(self->first);
     Py_CLEAR(self->last);
+#if CUSTOM_CACHE_NAME
+    Py_CLEAR(self->name);
+#endif
+
+    return 0;
+}
+
+/*
+ A freelist for Custom objects:
+ Programs that create and drop Custom objects at a high rate spend much of their time in the allocator, and every allocation of a GC object also counts
+ towards the next collection.
+ Like the built-in tuple and float types, custom4 therefore keeps the memory of recently deallocated Custom objects on a freelist and hands it out again
+ from Custom_alloc(); a recycled object is cleared and re-initialized, which costs far less than a trip through the GC allocator.
+ The objects themselves already come from pymalloc, which carves blocks of one size class out of fixed-size pool pages, so the freelist does not need a
+ slab allocator of its own.
+ At most CUSTOM_FREELIST_MAXLEN objects are kept by default; custom4.set_freelist_cap(n) changes the limit at run time, and custom4.freelist_stats()
+ reports the hits and misses so the limit can be sized.
+ Only exact Custom instances are recycled; subclasses may have a different size and use the generic allocator.
+*/
+
+#ifndef CUSTOM_FREELIST_MAXLEN
+#define CUSTOM_FREELIST_MAXLEN 1024
+#endif
+
+static PyTypeObject CustomType;
+
+/* Free objects are linked through their first field */
+
+static CustomObject *Custom_freelist = NULL;
+static Py_ssize_t Custom_numfree = 0;
+static Py_ssize_t Custom_freelist_cap = CUSTOM_FREELIST_MAXLEN;
+static unsigned long long Custom_freelist_hits = 0, Custom_freelist_misses = 0;
+
+/* The default strings of a new object; "" is a shared singleton in CPython */
+
+static PyObject *Custom_empty = NULL;
+
+static PyObject *
+
+Custom_alloc(PyTypeObject *type, Py_ssize_t nitems)
+{
+    CustomObject *self = Custom_freelist;
+
+    if (type != &CustomType)
+        return PyType_GenericAlloc(type, nitems);
+
+    /* Exact Custom objects start untracked; see Custom_maybe_track() */
+
+    if (self == NULL) {
+        Custom_freelist_misses++;
+
+        self = (CustomObject *) PyType_GenericAlloc(type, nitems);
+
+        if (self != NULL)
+            PyObject_GC_UnTrack(self);
+
+        return (PyObject *) self;
+    }
+
+    Custom_freelist = (CustomObject *) self->first;
+    Custom_numfree--;
+    Custom_freelist_hits++;
+
+    memset(&self->first, 0, sizeof(CustomObject) - offsetof(CustomObject, first));
+    PyObject_Init((PyObject *) self, type);
+
+    return (PyObject *) self;
+}
+
+static void
+
+Custom_free(void *op)
+{
+    CustomObject *self = (CustomObject *) op;
+
+    /* Custom_dealloc() has already untracked and cleared the object */
+
+    if (Py_TYPE(self) == &CustomType && Custom_numfree < Custom_freelist_cap) {
+        self->first = (PyObject *) Custom_freelist;
+        Custom_freelist = self;
+        Custom_numfree++;
+
+        return;
+    }
+
+    PyObject_GC_Del(op);
+}
+
+static PyObject *
+
+custom4_set_freelist_cap(PyObject *module, PyObject *arg)
+{
+    Py_ssize_t cap = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (cap == -1 && PyErr_Occurred())
+        return NULL;
+
+    if (cap < 0) {
+        PyErr_SetString(PyExc_ValueError, "freelist cap must not be negative");
+
+        return NULL;
+    }
+
+    Custom_freelist_cap = cap;
+
+    while (Custom_numfree > cap) {
+        CustomObject *self = Custom_freelist;
+
+        Custom_freelist = (CustomObject *) self->first;
+        Custom_numfree--;
+
+        PyObject_GC_Del(self);
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+custom4_freelist_stats(PyObject *module, PyObject *Py_UNUSED(ignored))
+{
+    return Py_BuildValue("{sKsKsnsn}",
+                         "hits", Custom_freelist_hits,
+                         "misses", Custom_freelist_misses,
+                         "size", Custom_numfree,
+                         "cap", Custom_freelist_cap);
+}
+
+/*
+ Interning first and last names:
+ Real data sets repeat the same few names over and over, but every Custom object keeps whichever string object it was given, so memory grows with the
+ number of objects rather than with the number of distinct names.
+ When the interning pool is enabled, Custom_init(), the setters and Custom_vectorcall() store the pool's copy of an equal string instead, and drop theirs.
+ The pool is a dict mapping each string to itself and is bounded: when it is full the oldest entry is evicted (objects still holding that string keep it).
+ Entries only ever leave the pool in the order they came in, so a ring buffer of the pooled strings, oldest first, finds the entry to evict in constant
+ time however large the pool is.
+ custom4.set_intern_pool(n) enables the pool with room for n strings (0, the default, disables it and empties it), and custom4.intern_stats() reports
+ the hits, misses and evictions.
+ Two names taken from the pool are equal exactly when they are the same object; since an evicted name can still be held by some objects,
+ Custom_str_eq() uses the pointer test as a fast path and only compares the text when it fails.
+ Only exact str objects are interned; instances of str subclasses are stored as given.
+*/
+
+static PyObject *Custom_intern_pool = NULL;
+static Py_ssize_t Custom_intern_cap = 0;
+static unsigned long long Custom_intern_hits = 0, Custom_intern_misses = 0, Custom_intern_evictions = 0;
+
+/* The pooled strings in insertion order: Custom_intern_order[(Custom_intern_head + i) % Custom_intern_cap] for i < the size of the pool (borrowed) */
+
+static PyObject **Custom_intern_order = NULL;
+static Py_ssize_t Custom_intern_head = 0;
+
+/* Evict the oldest entries until at most n are left */
+
+static int
+
+Custom_intern_trim(Py_ssize_t n)
+{
+    while (PyDict_GET_SIZE(Custom_intern_pool) > n) {
+        PyObject *key = Custom_intern_order[Custom_intern_head];
+        int res;
+
+        Py_INCREF(key);
+        res = PyDict_DelItem(Custom_intern_pool, key);
+        Py_DECREF(key);
+
+        if (res < 0)
+            return -1;
+
+        Custom_intern_head = (Custom_intern_head + 1) % Custom_intern_cap;
+        Custom_intern_evictions++;
+    }
+
+    return 0;
+}
+
+/* Return a new reference to the pooled string equal to s */
+
+static PyObject *
+
+Custom_intern(PyObject *s)
+{
+    PyObject *pooled;
+
+    if (Custom_intern_cap == 0 || !PyUnicode_CheckExact(s)) {
+        Py_INCREF(s);
+
+        return s;
+    }
+
+    pooled = PyDict_GetItemWithError(Custom_intern_pool, s);
+
+    if (pooled != NULL) {
+        Custom_intern_hits++;
+        Py_INCREF(pooled);
+
+        return pooled;
+    }
+
+    if (PyErr_Occurred())
+        return NULL;
+
+    Custom_intern_misses++;
+
+    if (Custom_intern_trim(Custom_intern_cap - 1) < 0 || PyDict_SetItem(Custom_intern_pool, s, s) < 0)
+        return NULL;
+
+    Custom_intern_order[(Custom_intern_head + PyDict_GET_SIZE(Custom_intern_pool) - 1) % Custom_intern_cap] = s;
+    Py_INCREF(s);
+
+    return s;
+}
+
+static inline int
+
+Custom_str_eq(PyObject *a, PyObject *b)
+{
+    return a == b || PyUnicode_Compare(a, b) == 0;
+}
+
+static PyObject *
+
+custom4_set_intern_pool(PyObject *module, PyObject *arg)
+{
+    Py_ssize_t cap = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+
+    if (cap == -1 && PyErr_Occurred())
+        return NULL;
+
+    if (cap < 0) {
+        PyErr_SetString(PyExc_ValueError, "intern pool size must not be negative");
+
+        return NULL;
+    }
+
+    if (Custom_intern_pool == NULL) {
+        Custom_intern_pool = PyDict_New();
+
+        if (Custom_intern_pool == NULL)
+            return NULL;
+    }
+
+    if (cap == 0) {
+        PyDict_Clear(Custom_intern_pool);
+        PyMem_Free(Custom_intern_order);
+        Custom_intern_order = NULL;
+        Custom_intern_head = 0;
+        Custom_intern_cap = 0;
+
+        Py_RETURN_NONE;
+    }
+
+    /* Evict down to the new size first, then move the survivors, oldest first, to the front of a ring of the new size */
+
+    if (Custom_intern_cap > 0 && Custom_intern_trim(cap) < 0)
+        return NULL;
+
+    if (cap != Custom_intern_cap) {
+        Py_ssize_t i, size = PyDict_GET_SIZE(Custom_intern_pool);
+        PyObject **order = PyMem_New(PyObject *, cap);
+
+        if (order == NULL)
+            return PyErr_NoMemory();
+
+        for (i = 0; i < size; i++)
+            order[i] = Custom_intern_order[(Custom_intern_head + i) % Custom_intern_cap];
+
+        PyMem_Free(Custom_intern_order);
+        Custom_intern_order = order;
+        Custom_intern_head = 0;
+        Custom_intern_cap = cap;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+custom4_intern_stats(PyObject *module, PyObject *Py_UNUSED(ignored))
+{
+    return Py_BuildValue("{sKsKsKsnsn}",
+                         "hits", Custom_intern_hits,
+                         "misses", Custom_intern_misses,
+                         "evictions", Custom_intern_evictions,
+                         "size", Custom_intern_pool ? PyDict_GET_SIZE(Custom_intern_pool) : 0,
+                         "cap", Custom_intern_cap);
+}
+
+/*
+ Untracking Custom objects that cannot be part of a cycle:
+ Every object of a type with Py_TPFLAGS_HAVE_GC is normally tracked, and every collection visits it through Custom_traverse(), even though a Custom object
+ whose first and last are exact str objects cannot be part of a reference cycle: str objects hold no references.
+ Like the interpreter does for tuples and dicts, custom4 keeps such objects out of the collector: Custom_alloc() returns exact Custom objects untracked,
+ and Custom_maybe_track() tracks one only once it stores something that could lead back to it, such as an instance of a str subclass (which may have a
+ __dict__).
+ An object is never untracked again after that, so the collector never sees an object disappear from its lists while it is using them.
+ Subclasses of Custom may add fields of their own and are always tracked.
+ custom4.defer_tracking(True) goes one step further for bulk creation: until it is switched off again, Custom_maybe_track() does nothing at all, so the
+ caller promises not to build reference cycles through the objects it creates meanwhile; objects that are part of a cycle but untracked are never
+ collected.
+ gc.is_tracked() shows whether an object is tracked.
+*/
+
+#if PY_VERSION_HEX < 0x03090000
+#define PyObject_GC_IsTracked(op) _PyObject_GC_IS_TRACKED(op)
+#endif
+
+static int Custom_defer_tracking = 0;
+
+static void
+
+Custom_maybe_track(CustomObject *self)
+{
+    if (Custom_defer_tracking || Py_TYPE(self) != &CustomType || PyObject_GC_IsTracked((PyObject *) self))
+        return;
+
+    if (!PyUnicode_CheckExact(self->first) || !PyUnicode_CheckExact(self->last))
+        PyObject_GC_Track(self);
+}
+
+static PyObject *
+
+custom4_defer_tracking(PyObject *module, PyObject *arg)
+{
+    int defer = PyObject_IsTrue(arg);
+
+    if (defer < 0)
+        return NULL;
+
+    Custom_defer_tracking = defer;
+
+    Py_RETURN_NONE;
+}
+
+/*
+ Keeping short names inline:
+ Indexing a CustomArray creates a Custom object for the row, and decoding its first and last names costs two more allocations although many callers only
+ look at number.
+ A Custom object can therefore also hold its names as UTF-8 text in the space of its three pointers (24 bytes on 64-bit platforms), with inlined set and
+ the two lengths stored in padding that the structure had anyway, so the object does not grow.
+ CustomArray_item() uses this form whenever both names fit, and Custom_materialize() decodes them into str objects the first time anything needs them:
+ the getters, name(), Custom_init(), the setters and CustomArray.append() all call it first.
+ An inlined object holds no references, so Custom_traverse() and Custom_clear() have nothing to do for it.
+ Text loaded from a damaged file is only decoded then, and an invalid name raises UnicodeDecodeError on first access.
+*/
+
+static int
+
+Custom_materialize(CustomObject *self)
+{
+    PyObject *first, *last;
+
+    if (!self->inlined)
+        return 0;
+
+    first = PyUnicode_DecodeUTF8(self->text, self->first_size, NULL);
+
+    if (first == NULL)
+        return -1;
+
+    last = PyUnicode_DecodeUTF8(self->text + self->first_size, self->last_size, NULL);
+
+    if (last == NULL) {
+        Py_DECREF(first);
+
+        return -1;
+    }
+
+    /* The text shares its space with the pointers, so nothing is stored until both names are ready */
+
+    Py_SETREF(first, Custom_intern(first));
+    Py_SETREF(last, Custom_intern(last));
+
+    if (first == NULL || last == NULL) {
+        Py_XDECREF(first);
+        Py_XDECREF(last);
+
+        return -1;
+    }
+
+    self->inlined = 0;
+    self->first = first;
+    self->last = last;
+#if CUSTOM_CACHE_NAME
+    self->name = NULL;
+#endif
 
     return 0;
 }
@@ -82,20 +504,11 @@ Custom_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     self = (CustomObject *) type->tp_alloc(type, 0);
 
     if (self != NULL) {
-        self->first = PyUnicode_FromString("");
-
-        if (self->first == NULL) {
-            Py_DECREF(self);
+        Py_INCREF(Custom_empty);
+        self->first = Custom_empty;
 
-            return NULL;
-        }
-        self->last = PyUnicode_FromString("");
-
-        if (self->last == NULL) {
-            Py_DECREF(self);
-
-            return NULL;
-        }
+        Py_INCREF(Custom_empty);
+        self->last = Custom_empty;
 
         self->number = 0;
     }
@@ -111,14 +524,27 @@ Custom_init(CustomObject *self, PyObject *args, PyObject *kwds)
 
     PyObject *first = NULL, *last = NULL, *tmp;
 
+    if (Custom_materialize(self) < 0)
+        return -1;
+
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "|UUi", kwlist,
                                      &first, &last,
                                      &self->number))
         return -1;
 
+    /* Intern both names before assigning either, so a failure leaves the object and its cached name as they were */
+
+    if (first && (first = Custom_intern(first)) == NULL)
+        return -1;
+
+    if (last && (last = Custom_intern(last)) == NULL) {
+        Py_XDECREF(first);
+
+        return -1;
+    }
+
     if (first) {
         tmp = self->first;
-        Py_INCREF(first);
         self->first = first;
 
         Py_DECREF(tmp);
@@ -126,13 +552,16 @@ Custom_init(CustomObject *self, PyObject *args, PyObject *kwds)
 
     if (last) {
         tmp = self->last;
-        Py_INCREF(last);
-
         self->last = last;
 
         Py_DECREF(tmp);
     }
 
+    if (first || last) {
+        Custom_INVALIDATE(self);
+        Custom_maybe_track(self);
+    }
+
     return 0;
 }
 
@@ -146,6 +575,9 @@ static PyObject *
 
 Custom_getfirst(CustomObject *self, void *closure)
 {
+    if (Custom_materialize(self) < 0)
+        return NULL;
+
     Py_INCREF(self->first);
 
     return self->first;
@@ -168,10 +600,14 @@ Custom_setfirst(CustomObject *self, PyObject *value, void *closure)
         return -1;
     }
 
-    Py_INCREF(value);
+    if (Custom_materialize(self) < 0 || (value = Custom_intern(value)) == NULL)
+        return -1;
+
     Py_CLEAR(self->first);
+    Custom_INVALIDATE(self);
 
     self->first = value;
+    Custom_maybe_track(self);
 
     return 0;
 }
@@ -180,6 +616,9 @@ static PyObject *
 
 Custom_getlast(CustomObject *self, void *closure)
 {
+    if (Custom_materialize(self) < 0)
+        return NULL;
+
     Py_INCREF(self->last);
 
     return self->last;
@@ -203,10 +642,14 @@ Custom_setlast(CustomObject *self, PyObject *value, void *closure)
 
     }
 
-    Py_INCREF(value);
+    if (Custom_materialize(self) < 0 || (value = Custom_intern(value)) == NULL)
+        return -1;
+
     Py_CLEAR(self->last);
+    Custom_INVALIDATE(self);
 
     self->last = value;
+    Custom_maybe_track(self);
 
     return 0;
 }
@@ -219,62 +662,2476 @@ static PyGetSetDef Custom_getsetters[] = {
     {NULL}  /* Sentinel */
 };
 
+/*
+ Caching the name:
+ Code that displays Custom objects tends to call name() many times between two changes of the object, and each call formats a new string.
+ Custom_name() therefore keeps the string it returned in the name field and hands out the same object until first or last is assigned again;
+ Custom_init() and both setters drop the cached string through Custom_INVALIDATE().
+ The cached string is an ordinary reference, so Custom_traverse() visits it and Custom_clear() releases it.
+*/
+
 static PyObject *
 
 Custom_name(CustomObject *self, PyObject *Py_UNUSED(ignored))
 {
+    if (Custom_materialize(self) < 0)
+        return NULL;
+
+#if CUSTOM_CACHE_NAME
+    if (self->name == NULL) {
+        self->name = PyUnicode_FromFormat("%S %S", self->first, self->last);
+
+        if (self->name == NULL)
+            return NULL;
+    }
+
+    Py_INCREF(self->name);
+
+    return self->name;
+#else
 
     return PyUnicode_FromFormat("%S %S", self->first, self->last);
+#endif
 }
 
-static PyMethodDef Custom_methods[] = {
-    {"name", (PyCFunction) Custom_name, METH_NOARGS,
-     "Return the name, combining the first and last name"
-    },
-    {NULL}  /* Sentinel */
-};
+/*
+ Hashing and comparing Custom objects:
+ Two Custom objects compare equal when first, last and number are equal, and they order like the tuples (first, last, number), so they can be sorted
+ and used as dict keys or set members without building a tuple for every lookup.
+ Custom_hash() returns the same value as hash((first, last, number)) and follows the xxHash-based combination of Objects/tupleobject.c.
+ The part that depends on the two names is cached in names_hash; Custom_init() and the setters reset it through Custom_INVALIDATE(), while number, which
+ can be changed through the member descriptor without the type noticing, is mixed in on every call.
+ As with any mutable key, changing an object while it is stored in a dict or set makes it impossible to find there.
+*/
+
+#if SIZEOF_PY_UHASH_T > 4
+#define Custom_XXPRIME_1 ((Py_uhash_t) 11400714785074694791ULL)
+#define Custom_XXPRIME_2 ((Py_uhash_t) 14029467366897019727ULL)
+#define Custom_XXPRIME_5 ((Py_uhash_t) 2870177450012600261ULL)
+#define Custom_XXROTATE(x) ((x << 31) | (x >> 33))
+#else
+#define Custom_XXPRIME_1 ((Py_uhash_t) 2654435761UL)
+#define Custom_XXPRIME_2 ((Py_uhash_t) 2246822519UL)
+#define Custom_XXPRIME_5 ((Py_uhash_t) 374761393UL)
+#define Custom_XXROTATE(x) ((x << 13) | (x >> 19))
+#endif
+
+static Py_uhash_t
+
+Custom_hash_lane(Py_uhash_t acc, Py_uhash_t lane)
+{
+    acc += lane * Custom_XXPRIME_2;
+    acc = Custom_XXROTATE(acc);
+    acc *= Custom_XXPRIME_1;
 
-static PyTypeObject CustomType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "custom4.Custom",
-    .tp_doc = "Custom objects",
-    .tp_basicsize = sizeof(CustomObject),
-    .tp_itemsize = 0,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
-    .tp_new = Custom_new,
-    .tp_init = (initproc) Custom_init,
-    .tp_dealloc = (destructor) Custom_dealloc,
-    .tp_traverse = (traverseproc) Custom_traverse,
-    .tp_clear = (inquiry) Custom_clear,
-    .tp_members = Custom_members,
-    .tp_methods = Custom_methods,
-    .tp_getset = Custom_getsetters,
-};
+    return acc;
+}
 
-static PyModuleDef custommodule = {
-    PyModuleDef_HEAD_INIT,
-    .m_name = "custom4",
-    .m_doc = "Example module that creates an extension type.",
-    .m_size = -1,
-};
+static Py_hash_t
 
-PyMODINIT_FUNC
+Custom_hash(CustomObject *self)
+{
+    Py_uhash_t acc = (Py_uhash_t) self->names_hash;
 
-PyInit_custom4(void)
+    if (acc == 0) {
+        Py_hash_t first, last;
 
-{
-    PyObject *m;
+        if (Custom_materialize(self) < 0 ||
+            (first = PyObject_Hash(self->first)) == -1 ||
+            (last = PyObject_Hash(self->last)) == -1)
+            return -1;
 
-    if (PyType_Ready(&CustomType) < 0)
-        return NULL;
+        acc = Custom_hash_lane(Custom_XXPRIME_5, (Py_uhash_t) first);
+        acc = Custom_hash_lane(acc, (Py_uhash_t) last);
 
-    m = PyModule_Create(&custommodule);
+        self->names_hash = (Py_hash_t) acc;
+    }
 
-    if (m == NULL)
-        return NULL;
+    /* hash(int) is the int itself, except that -1 becomes -2 */
 
-    Py_INCREF(&CustomType);
-    PyModule_AddObject(m, "Custom", (PyObject *) &CustomType);
+    acc = Custom_hash_lane(acc, (Py_uhash_t) (self->number == -1 ? -2 : self->number));
+    acc += 3 ^ (Custom_XXPRIME_5 ^ 3527539UL);
+
+    if (acc == (Py_uhash_t) -1)
+        return 1546275796;
+
+    return (Py_hash_t) acc;
+}
+
+static PyObject *
+
+Custom_richcompare(PyObject *a, PyObject *b, int op)
+{
+    CustomObject *x = (CustomObject *) a, *y = (CustomObject *) b;
+    int cmp;
+
+    if (!PyObject_TypeCheck(a, &CustomType) || !PyObject_TypeCheck(b, &CustomType))
+        Py_RETURN_NOTIMPLEMENTED;
+
+    if (Custom_materialize(x) < 0 || Custom_materialize(y) < 0)
+        return NULL;
+
+    /* Equal numbers are the cheapest test to fail, and interned names compare by pointer */
+
+    if (op == Py_EQ || op == Py_NE) {
+        int eq = x->number == y->number && Custom_str_eq(x->first, y->first) && Custom_str_eq(x->last, y->last);
+
+        if (PyErr_Occurred())
+            return NULL;
+
+        return PyBool_FromLong(eq == (op == Py_EQ));
+    }
+
+    cmp = (x->first == y->first) ? 0 : PyUnicode_Compare(x->first, y->first);
+
+    if (cmp == 0)
+        cmp = (x->last == y->last) ? 0 : PyUnicode_Compare(x->last, y->last);
+
+    if (cmp == 0)
+        cmp = (x->number > y->number) - (x->number < y->number);
+
+    if (PyErr_Occurred())
+        return NULL;
+
+    Py_RETURN_RICHCOMPARE(cmp, 0, op);
+}
+
+/*
+ Creating many objects at once:
+ Custom.from_columns(firsts, lasts, numbers) builds a list of Custom objects from three columns of equal length in a single C loop, without packing
+ and parsing arguments for every object.
+ firsts and lasts are sequences of str; numbers is a sequence of int or any one-dimensional buffer of C integers, such as an array.array or a NumPy
+ array, whose items are read directly from memory.
+ The objects are filled in the same way as by Custom_vectorcall(), so they are interned and tracked like objects created one at a time; for a subclass
+ the class itself is called for each row so that its __init__ runs.
+*/
+
+/* Read item i of a buffer of C integers; the format has been checked by Custom_column_format() */
+
+static long long
+
+Custom_column_item(Py_buffer *view, Py_ssize_t i)
+{
+    const char *p = (const char *) view->buf + i * view->itemsize;
+    unsigned long long u;
+
+    switch (view->format[view->format[0] == '@']) {
+    case 'b': return *(const signed char *) p;
+    case 'B': return *(const unsigned char *) p;
+    case 'h': return *(const short *) p;
+    case 'H': return *(const unsigned short *) p;
+    case 'i': return *(const int *) p;
+    case 'I': return *(const unsigned int *) p;
+    case 'l': return *(const long *) p;
+    case 'q': return *(const long long *) p;
+    case 'n': return *(const Py_ssize_t *) p;
+    case 'L': u = *(const unsigned long *) p; break;
+    case 'Q': u = *(const unsigned long long *) p; break;
+    default:  u = *(const size_t *) p; break;
+    }
+
+    /* Anything above LLONG_MAX is out of range for a C int anyway */
+
+    return (u > LLONG_MAX) ? LLONG_MAX : (long long) u;
+}
+
+static int
+
+Custom_column_format(Py_buffer *view)
+{
+    const char *format = view->format ? view->format : "B";
+
+    if (format[0] == '@')
+        format++;
+
+    if (view->ndim != 1 || format[0] == '\0' || format[1] != '\0' || strchr("bBhHiIlLqQnN", format[0]) == NULL) {
+        PyErr_Format(PyExc_TypeError,
+                     "numbers must be a one-dimensional buffer of integers, not format '%s'", format);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static PyObject *
+
+Custom_from_columns(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"firsts", "lasts", "numbers", NULL};
+
+    PyObject *firsts, *lasts, *numbers, *fs = NULL, *ls = NULL, *ns = NULL, *result = NULL;
+    Py_buffer view = {NULL};
+    Py_ssize_t n, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOO:from_columns", kwlist, &firsts, &lasts, &numbers))
+        return NULL;
+
+    if ((fs = PySequence_Fast(firsts, "firsts must be a sequence")) == NULL ||
+        (ls = PySequence_Fast(lasts, "lasts must be a sequence")) == NULL)
+        goto done;
+
+    if (PyObject_CheckBuffer(numbers)) {
+        if (PyObject_GetBuffer(numbers, &view, PyBUF_FORMAT | PyBUF_ND) < 0 || Custom_column_format(&view) < 0)
+            goto done;
+
+        n = view.shape[0];
+    }
+    else {
+        if ((ns = PySequence_Fast(numbers, "numbers must be a sequence or a buffer")) == NULL)
+            goto done;
+
+        n = PySequence_Fast_GET_SIZE(ns);
+    }
+
+    if (PySequence_Fast_GET_SIZE(fs) != n || PySequence_Fast_GET_SIZE(ls) != n) {
+        PyErr_SetString(PyExc_ValueError, "firsts, lasts and numbers must have the same length");
+
+        goto done;
+    }
+
+    if ((result = PyList_New(n)) == NULL)
+        goto done;
+
+    for (i = 0; i < n; i++) {
+        PyObject *first = PySequence_Fast_GET_ITEM(fs, i), *last = PySequence_Fast_GET_ITEM(ls, i);
+        CustomObject *self;
+        long long number;
+
+        if (!PyUnicode_Check(first) || !PyUnicode_Check(last)) {
+            PyErr_Format(PyExc_TypeError, "row %zd: first and last must be str", i);
+
+            goto error;
+        }
+
+        if (ns != NULL) {
+            PyObject *item = PySequence_Fast_GET_ITEM(ns, i);
+
+            if (PyFloat_Check(item)) {
+                PyErr_Format(PyExc_TypeError, "row %zd: integer number expected, got float", i);
+
+                goto error;
+            }
+
+            number = PyLong_AsLongLong(item);
+
+            if (number == -1 && PyErr_Occurred())
+                goto error;
+        }
+        else
+            number = Custom_column_item(&view, i);
+
+        if (number > INT_MAX || number < INT_MIN) {
+            PyErr_Format(PyExc_OverflowError, "row %zd: number does not fit in a C int", i);
+
+            goto error;
+        }
+
+        if (type != &CustomType) {
+            PyObject *obj = PyObject_CallFunction((PyObject *) type, "OOi", first, last, (int) number);
+
+            if (obj == NULL)
+                goto error;
+
+            PyList_SET_ITEM(result, i, obj);
+
+            continue;
+        }
+
+        self = (CustomObject *) CustomType.tp_alloc(&CustomType, 0);
+
+        if (self == NULL)
+            goto error;
+
+        PyList_SET_ITEM(result, i, (PyObject *) self);
+
+        self->first = Custom_intern(first);
+        self->last = Custom_intern(last);
+        self->number = (int) number;
+
+        if (self->first == NULL || self->last == NULL)
+            goto error;
+
+        Custom_maybe_track(self);
+    }
+
+    goto done;
+
+error:
+    Py_CLEAR(result);
+
+done:
+    if (view.obj != NULL)
+        PyBuffer_Release(&view);
+
+    Py_XDECREF(fs);
+    Py_XDECREF(ls);
+    Py_XDECREF(ns);
+
+    return result;
+}
+
+static PyMethodDef Custom_methods[] = {
+    {"name", (PyCFunction) Custom_name, METH_NOARGS,
+     "Return the name, combining the first and last name"
+    },
+    {"from_columns", (PyCFunction)(void(*)(void)) Custom_from_columns, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+     "Return a list of Custom objects built from columns of first names, last names and numbers"
+    },
+    {NULL}  /* Sentinel */
+};
+
+/*
+ Custom(first, last, number) normally runs Custom_new() and then Custom_init(): the arguments are packed into a tuple and a dictionary, parsed by
+ PyArg_ParseTupleAndKeywords(), and two empty strings are stored only to be replaced straight away.
+ Since Python 3.9 a type can provide a vectorcall function in tp_vectorcall, which is used when the type object itself is called.
+ Custom_vectorcall() takes the arguments straight from the argument vector and fills in the fields of the new object in one pass, with the same rules as
+ Custom_init(): first and last must be strings, number must be an int, and all three may be given by position or by name.
+ tp_vectorcall is never inherited, so subclasses still go through Custom_new() and their own tp_init.
+ Build with -DCUSTOM_VECTORCALL=0 to leave tp_vectorcall empty, so that Custom itself is created by Custom_new() and Custom_init() as well.
+*/
+
+#ifndef CUSTOM_VECTORCALL
+#define CUSTOM_VECTORCALL (PY_VERSION_HEX >= 0x03090000)
+#endif
+
+#if CUSTOM_VECTORCALL
+
+static PyObject *Custom_kwnames[3];     /* "first", "last", "number", interned by PyInit_custom4() */
+
+static PyObject *
+
+Custom_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames)
+{
+    static const char *const names[] = {"first", "last", "number"};
+
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf), i, k;
+    PyObject *values[3] = {NULL, NULL, NULL};
+    CustomObject *self;
+    long number = 0;
+
+    if (nargs > 3) {
+        PyErr_Format(PyExc_TypeError,
+                     "Custom() takes at most 3 arguments (%zd given)", nargs);
+
+        return NULL;
+    }
+
+    for (i = 0; i < nargs; i++)
+        values[i] = args[i];
+
+    for (k = 0; kwnames != NULL && k < PyTuple_GET_SIZE(kwnames); k++) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+
+        for (i = 0; i < 3 && Custom_kwnames[i] != key; i++)
+            ;
+
+        /* Keyword names are nearly always interned; compare the text only if no pointer matched */
+
+        if (i == 3) {
+            for (i = 0; i < 3 && PyUnicode_Compare(Custom_kwnames[i], key) != 0; i++)
+                ;
+        }
+
+        if (i == 3) {
+            PyErr_Format(PyExc_TypeError,
+                         "'%S' is an invalid keyword argument for Custom()", key);
+
+            return NULL;
+        }
+
+        if (values[i] != NULL) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for Custom() given by name ('%s') and position (%zd)",
+                         names[i], i + 1);
+
+            return NULL;
+        }
+
+        values[i] = args[nargs + k];
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (values[i] != NULL && !PyUnicode_Check(values[i])) {
+            PyErr_Format(PyExc_TypeError,
+                         "Custom() argument %zd must be str, not %.50s",
+                         i + 1, Py_TYPE(values[i])->tp_name);
+
+            return NULL;
+        }
+    }
+
+    if (values[2] != NULL) {
+        if (PyFloat_Check(values[2])) {
+            PyErr_SetString(PyExc_TypeError, "integer argument expected, got float");
+
+            return NULL;
+        }
+
+        number = PyLong_AsLong(values[2]);
+
+        if (number == -1 && PyErr_Occurred())
+            return NULL;
+
+        if (number > INT_MAX) {
+            PyErr_SetString(PyExc_OverflowError,
+                            "signed integer is greater than maximum");
+
+            return NULL;
+        }
+
+        if (number < INT_MIN) {
+            PyErr_SetString(PyExc_OverflowError,
+                            "signed integer is less than minimum");
+
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        values[i] = Custom_intern(values[i] ? values[i] : Custom_empty);
+
+        if (values[i] == NULL) {
+            Py_XDECREF(values[0]);
+
+            return NULL;
+        }
+    }
+
+    self = (CustomObject *) CustomType.tp_alloc(&CustomType, 0);
+
+    if (self == NULL) {
+        Py_DECREF(values[0]);
+        Py_DECREF(values[1]);
+
+        return NULL;
+    }
+
+    self->first = values[0];
+    self->last = values[1];
+    self->number = (int) number;
+
+    Custom_maybe_track(self);
+
+    return (PyObject *) self;
+}
+
+#endif
+
+static PyTypeObject CustomType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "custom4.Custom",
+    .tp_doc = "Custom objects",
+    .tp_basicsize = sizeof(CustomObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_new = Custom_new,
+    .tp_alloc = Custom_alloc,
+    .tp_free = Custom_free,
+    .tp_init = (initproc) Custom_init,
+    .tp_dealloc = (destructor) Custom_dealloc,
+    .tp_traverse = (traverseproc) Custom_traverse,
+    .tp_clear = (inquiry) Custom_clear,
+    .tp_members = Custom_members,
+    .tp_methods = Custom_methods,
+    .tp_getset = Custom_getsetters,
+    .tp_hash = (hashfunc) Custom_hash,
+    .tp_richcompare = Custom_richcompare,
+#if CUSTOM_VECTORCALL
+    .tp_vectorcall = Custom_vectorcall,
+#endif
+};
+
+/*
+ Storing many records in columns:
+ A million Custom objects cost a million object headers, GC headers and pairs of string objects, and summing their numbers touches every one of them.
+ CustomArray keeps the same three fields column by column instead: the numbers in one contiguous int array, and each string column as a single UTF-8
+ buffer plus an array of end offsets.
+ Indexing a CustomArray creates a Custom object for that row on demand (a copy; changing it does not change the array), while sum(), min(), max() and
+ filter() work on the number column directly and never create per-row objects.
+ CustomArray holds no references to other objects, so it does not need to support the cyclic GC.
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    char *data;             /* UTF-8 text of all rows, back to back */
+    Py_ssize_t size, allocated;
+    Py_ssize_t *end;        /* end offset of each row; row i starts at end[i - 1] */
+} CustomStrColumn;
+
+typedef struct {
+    PyObject_HEAD
+    Py_ssize_t length, allocated;
+    int *number;
+    CustomStrColumn first, last;
+    char *mapping;          /* file mapping the columns point into, see custom4.load() */
+    size_t mapping_size;
+} CustomArrayObject;
+
+static PyTypeObject CustomArrayType;
+
+static int CustomArray_unmap(CustomArrayObject *self);
+
+static void
+
+CustomStrColumn_free(CustomStrColumn *col)
+{
+    PyMem_Free(col->data);
+    PyMem_Free(col->end);
+}
+
+static Py_ssize_t
+
+CustomStrColumn_start(CustomStrColumn *col, Py_ssize_t i)
+{
+    return (i == 0) ? 0 : col->end[i - 1];
+}
+
+/* Append the text of one row; the row arrays must already have room for it */
+
+static int
+
+CustomStrColumn_append(CustomStrColumn *col, Py_ssize_t row, const char *s, Py_ssize_t len)
+{
+    if (col->size + len > col->allocated) {
+        Py_ssize_t allocated = col->allocated * 2 + len + 64;
+        char *data = PyMem_Realloc(col->data, allocated);
+
+        if (data == NULL) {
+            PyErr_NoMemory();
+
+            return -1;
+        }
+
+        col->data = data;
+        col->allocated = allocated;
+    }
+
+    memcpy(col->data + col->size, s, len);
+    col->size += len;
+    col->end[row] = col->size;
+
+    return 0;
+}
+
+/* Make room for at least n more rows in the row arrays */
+
+static int
+
+CustomArray_reserve(CustomArrayObject *self, Py_ssize_t n)
+{
+    Py_ssize_t allocated;
+    int *number;
+    Py_ssize_t *first_end, *last_end;
+
+    if (self->length + n <= self->allocated)
+        return 0;
+
+    if (self->mapping != NULL && CustomArray_unmap(self) < 0)
+        return -1;
+
+    allocated = Py_MAX(self->allocated * 2, self->length + n);
+    allocated = Py_MAX(allocated, 16);
+
+    number = PyMem_Realloc(self->number, allocated * sizeof(int));
+
+    if (number != NULL)
+        self->number = number;
+
+    first_end = PyMem_Realloc(self->first.end, allocated * sizeof(Py_ssize_t));
+
+    if (first_end != NULL)
+        self->first.end = first_end;
+
+    last_end = PyMem_Realloc(self->last.end, allocated * sizeof(Py_ssize_t));
+
+    if (last_end != NULL)
+        self->last.end = last_end;
+
+    if (number == NULL || first_end == NULL || last_end == NULL) {
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    self->allocated = allocated;
+
+    return 0;
+}
+
+static int
+
+CustomArray_append_row(CustomArrayObject *self, PyObject *first, PyObject *last, int number)
+{
+    const char *s;
+    Py_ssize_t len, row = self->length;
+
+    if (CustomArray_reserve(self, 1) < 0)
+        return -1;
+
+    if ((s = PyUnicode_AsUTF8AndSize(first, &len)) == NULL ||
+        CustomStrColumn_append(&self->first, row, s, len) < 0)
+        return -1;
+
+    if ((s = PyUnicode_AsUTF8AndSize(last, &len)) == NULL ||
+        CustomStrColumn_append(&self->last, row, s, len) < 0) {
+        self->first.size = CustomStrColumn_start(&self->first, row);
+
+        return -1;
+    }
+
+    self->number[row] = number;
+    self->length++;
+
+    return 0;
+}
+
+static PyObject *
+
+CustomArray_append(CustomArrayObject *self, PyObject *item)
+{
+    CustomObject *obj = (CustomObject *) item;
+
+    if (!PyObject_TypeCheck(item, &CustomType)) {
+        PyErr_Format(PyExc_TypeError, "expected a Custom object, not %.50s",
+                     Py_TYPE(item)->tp_name);
+
+        return NULL;
+    }
+
+    if (Custom_materialize(obj) < 0 ||
+        CustomArray_append_row(self, obj->first, obj->last, obj->number) < 0)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+CustomArray_extend(CustomArrayObject *self, PyObject *iterable)
+{
+    PyObject *it, *item;
+
+    it = PyObject_GetIter(iterable);
+
+    if (it == NULL)
+        return NULL;
+
+    while ((item = PyIter_Next(it)) != NULL) {
+        PyObject *res = CustomArray_append(self, item);
+
+        Py_DECREF(item);
+
+        if (res == NULL) {
+            Py_DECREF(it);
+
+            return NULL;
+        }
+
+        Py_DECREF(res);
+    }
+
+    Py_DECREF(it);
+
+    if (PyErr_Occurred())
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+
+CustomArray_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"rows", NULL};
+
+    CustomArrayObject *self;
+    PyObject *rows = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:CustomArray", kwlist, &rows))
+        return NULL;
+
+    self = (CustomArrayObject *) type->tp_alloc(type, 0);
+
+    if (self != NULL && rows != NULL) {
+        PyObject *res = CustomArray_extend(self, rows);
+
+        if (res == NULL)
+            Py_CLEAR(self);
+        else
+            Py_DECREF(res);
+    }
+
+    return (PyObject *) self;
+}
+
+static void
+
+CustomArray_dealloc(CustomArrayObject *self)
+{
+    if (self->mapping != NULL)
+        munmap(self->mapping, self->mapping_size);
+    else {
+        PyMem_Free(self->number);
+        CustomStrColumn_free(&self->first);
+        CustomStrColumn_free(&self->last);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static Py_ssize_t
+
+CustomArray_length(CustomArrayObject *self)
+{
+    return self->length;
+}
+
+static PyObject *
+
+CustomStrColumn_get(CustomStrColumn *col, Py_ssize_t i)
+{
+    Py_ssize_t start = CustomStrColumn_start(col, i);
+
+    PyObject *s, *pooled;
+
+    if (start == col->end[i]) {
+        Py_INCREF(Custom_empty);
+
+        return Custom_empty;
+    }
+
+    s = PyUnicode_DecodeUTF8(col->data + start, col->end[i] - start, NULL);
+
+    if (s == NULL)
+        return NULL;
+
+    pooled = Custom_intern(s);
+    Py_DECREF(s);
+
+    return pooled;
+}
+
+static PyObject *
+
+CustomArray_item(CustomArrayObject *self, Py_ssize_t i)
+{
+    CustomObject *obj;
+    Py_ssize_t fs, ls, first_size, last_size;
+
+    if (i < 0 || i >= self->length) {
+        PyErr_SetString(PyExc_IndexError, "CustomArray index out of range");
+
+        return NULL;
+    }
+
+    obj = (CustomObject *) CustomType.tp_alloc(&CustomType, 0);
+
+    if (obj == NULL)
+        return NULL;
+
+    /* Short names stay UTF-8 until they are used; see Custom_materialize() */
+
+    fs = CustomStrColumn_start(&self->first, i);
+    ls = CustomStrColumn_start(&self->last, i);
+    first_size = self->first.end[i] - fs;
+    last_size = self->last.end[i] - ls;
+
+    if (first_size + last_size <= (Py_ssize_t) CUSTOM_INLINE_TEXT) {
+        memcpy(obj->text, self->first.data + fs, first_size);
+        memcpy(obj->text + first_size, self->last.data + ls, last_size);
+        obj->first_size = (unsigned char) first_size;
+        obj->last_size = (unsigned char) last_size;
+        obj->inlined = 1;
+        obj->number = self->number[i];
+
+        return (PyObject *) obj;
+    }
+
+    obj->first = CustomStrColumn_get(&self->first, i);
+    obj->last = CustomStrColumn_get(&self->last, i);
+    obj->number = self->number[i];
+
+    if (obj->first == NULL || obj->last == NULL) {
+        Py_DECREF(obj);
+
+        return NULL;
+    }
+
+    return (PyObject *) obj;
+}
+
+/*
+ The column operations are plain loops over the int array, which the compiler can vectorize.
+*/
+
+static PyObject *
+
+CustomArray_sum(CustomArrayObject *self, PyObject *Py_UNUSED(ignored))
+{
+    long long total = 0;
+    Py_ssize_t i;
+
+    for (i = 0; i < self->length; i++)
+        total += self->number[i];
+
+    return PyLong_FromLongLong(total);
+}
+
+static PyObject *
+
+CustomArray_minmax(CustomArrayObject *self, int want_max)
+{
+    int best;
+    Py_ssize_t i;
+
+    if (self->length == 0) {
+        PyErr_SetString(PyExc_ValueError, "empty CustomArray has no min or max");
+
+        return NULL;
+    }
+
+    best = self->number[0];
+
+    if (want_max) {
+        for (i = 1; i < self->length; i++)
+            best = (self->number[i] > best) ? self->number[i] : best;
+    }
+    else {
+        for (i = 1; i < self->length; i++)
+            best = (self->number[i] < best) ? self->number[i] : best;
+    }
+
+    return PyLong_FromLong(best);
+}
+
+static PyObject *
+
+CustomArray_min(CustomArrayObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return CustomArray_minmax(self, 0);
+}
+
+static PyObject *
+
+CustomArray_max(CustomArrayObject *self, PyObject *Py_UNUSED(ignored))
+{
+    return CustomArray_minmax(self, 1);
+}
+
+/* Copy the rows with lo <= number <= hi into a new CustomArray */
+
+static PyObject *
+
+CustomArray_filter(CustomArrayObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"lo", "hi", NULL};
+
+    CustomArrayObject *result;
+    int lo = INT_MIN, hi = INT_MAX;
+    Py_ssize_t i, n;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii:filter", kwlist, &lo, &hi))
+        return NULL;
+
+    result = (CustomArrayObject *) CustomArrayType.tp_alloc(&CustomArrayType, 0);
+
+    if (result == NULL)
+        return NULL;
+
+    for (i = 0, n = 0; i < self->length; i++)
+        n += (self->number[i] >= lo) & (self->number[i] <= hi);
+
+    if (CustomArray_reserve(result, n) < 0) {
+        Py_DECREF(result);
+
+        return NULL;
+    }
+
+    for (i = 0; i < self->length; i++) {
+        Py_ssize_t row = result->length, fs, ls;
+
+        if (self->number[i] < lo || self->number[i] > hi)
+            continue;
+
+        fs = CustomStrColumn_start(&self->first, i);
+        ls = CustomStrColumn_start(&self->last, i);
+
+        if (CustomStrColumn_append(&result->first, row, self->first.data + fs, self->first.end[i] - fs) < 0 ||
+            CustomStrColumn_append(&result->last, row, self->last.data + ls, self->last.end[i] - ls) < 0) {
+            Py_DECREF(result);
+
+            return NULL;
+        }
+
+        result->number[row] = self->number[i];
+        result->length++;
+    }
+
+    return (PyObject *) result;
+}
+
+static PySequenceMethods CustomArray_as_sequence = {
+    .sq_length = (lenfunc) CustomArray_length,
+    .sq_item = (ssizeargfunc) CustomArray_item,
+};
+
+static PyMethodDef CustomArray_methods[] = {
+    {"append", (PyCFunction) CustomArray_append, METH_O,
+     "Append the fields of a Custom object as a new row"
+    },
+    {"extend", (PyCFunction) CustomArray_extend, METH_O,
+     "Append the fields of every Custom object of an iterable"
+    },
+    {"sum", (PyCFunction) CustomArray_sum, METH_NOARGS,
+     "Return the sum of the number column"
+    },
+    {"min", (PyCFunction) CustomArray_min, METH_NOARGS,
+     "Return the smallest number"
+    },
+    {"max", (PyCFunction) CustomArray_max, METH_NOARGS,
+     "Return the largest number"
+    },
+    {"filter", (PyCFunction)(void(*)(void)) CustomArray_filter, METH_VARARGS | METH_KEYWORDS,
+     "Return a new CustomArray with the rows whose number lies in [lo, hi]"
+    },
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject CustomArrayType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "custom4.CustomArray",
+    .tp_doc = "Columnar storage for Custom records",
+    .tp_basicsize = sizeof(CustomArrayObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = CustomArray_new,
+    .tp_dealloc = (destructor) CustomArray_dealloc,
+    .tp_as_sequence = &CustomArray_as_sequence,
+    .tp_methods = CustomArray_methods,
+};
+
+/*
+ Saving and loading Custom records:
+ Pickling a list of Custom objects goes through __reduce__ and looks up every attribute of every object.
+ custom4.dump(objs, path) writes the records instead in the column layout of CustomArray, so both writing and reading are a handful of large,
+ sequential system calls:
+
+     header       48 bytes: magic "CUS4", format version, byte order mark, size of an offset, row count, sizes of the two text sections, checksum
+     first.end    row count offsets
+     last.end     row count offsets
+     number       row count C ints, padded to a multiple of 8 bytes
+     first.data   UTF-8 text of the first names
+     last.data    UTF-8 text of the last names
+
+ The checksum is a 64-bit Fletcher-style sum over the five sections that detects truncated or damaged files; it offers no protection against deliberate
+ tampering.
+ Numbers and offsets are stored in the byte order and width of the machine that wrote the file, and load() rejects a file written with different ones.
+ Like load(), dump() does all of its file I/O with the GIL released.
+ dump() writes a new file next to the target and renames it over the target, so readers see the old file or the new one and never a partial one.
+ Above all, a file that load() has mapped is never truncated under its mapping: an array loaded from it keeps the old contents, and the old file goes
+ away once the last such array does.
+ The new file gets the default permissions, 0666 less the umask.
+ A CustomArray passed to it could be changed by another thread meanwhile, so its sections are first copied into one buffer with the GIL held; an array
+ that dump() builds itself from other objects is private and is written directly.
+ custom4.load(path) returns a CustomArray.
+ With mmap=True the columns of that CustomArray point straight into a read-only mapping of the file, so nothing is copied and a row's strings are
+ decoded only when the row is indexed; the array copies its columns to memory of its own the first time rows are appended to it.
+ The offsets are checked when the file is loaded, so even a file with a matching checksum can never make the array read outside its text sections;
+ verify=False skips only the checksum.
+*/
+
+#define CUSTOM_DUMP_VERSION 1
+
+typedef struct {
+    char magic[4];          /* "CUS4" */
+    uint16_t version;       /* CUSTOM_DUMP_VERSION */
+    uint16_t byte_order;    /* 0x0102 as written by the saving machine */
+    uint32_t offset_size;   /* sizeof(Py_ssize_t) */
+    uint32_t reserved;
+    uint64_t count, first_size, last_size;
+    uint64_t checksum;
+} CustomDumpHeader;
+
+typedef struct {
+    uint64_t a, b;
+} CustomChecksum;
+
+static void
+
+CustomChecksum_update(CustomChecksum *sum, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    uint64_t a = sum->a, b = sum->b;
+    uint32_t w;
+
+    for (; size >= 4; p += 4, size -= 4) {
+        memcpy(&w, p, 4);
+        a += w;
+        b += a;
+    }
+
+    if (size > 0) {
+        w = 0;
+        memcpy(&w, p, size);
+        a += w;
+        b += a;
+    }
+
+    sum->a = a;
+    sum->b = b;
+}
+
+/* The sections of a file in the order they are stored in */
+
+static int
+
+Custom_dump_sections(CustomArrayObject *array, const void **data, size_t *size)
+{
+    static const uint64_t zero = 0;
+
+    size_t n = (size_t) array->length;
+
+    data[0] = array->first.end;   size[0] = n * sizeof(Py_ssize_t);
+    data[1] = array->last.end;    size[1] = n * sizeof(Py_ssize_t);
+    data[2] = array->number;      size[2] = n * sizeof(int);
+    data[3] = &zero;              size[3] = (8 - size[2] % 8) % 8;
+    data[4] = array->first.data;  size[4] = (size_t) array->first.size;
+    data[5] = array->last.data;   size[5] = (size_t) array->last.size;
+
+    return 6;
+}
+
+static int
+
+Custom_write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+
+    while (size > 0) {
+        ssize_t done = write(fd, p, size);
+
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        p += done;
+        size -= (size_t) done;
+    }
+
+    return 0;
+}
+
+static int
+
+Custom_read_all(int fd, void *data, size_t size)
+{
+    char *p = data;
+
+    while (size > 0) {
+        ssize_t done = read(fd, p, size);
+
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        if (done == 0) {
+            errno = EIO;
+
+            return -1;
+        }
+
+        p += done;
+        size -= (size_t) done;
+    }
+
+    return 0;
+}
+
+/* Create a file that nobody else uses in the directory of path; serial is taken with the GIL held, so two threads never try the same names */
+
+#define CUSTOM_DUMP_TRIES 100
+
+static unsigned int Custom_dump_serial = 0;
+
+static int
+
+Custom_open_temp(const char *path, char *tmp, size_t tmp_size, unsigned int serial)
+{
+    int fd = -1, i;
+
+    for (i = 0; i < CUSTOM_DUMP_TRIES; i++) {
+        PyOS_snprintf(tmp, tmp_size, "%s.%ld.%u.%d.tmp", path, (long) getpid(), serial, i);
+
+        fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+        if (fd >= 0 || errno != EEXIST)
+            break;
+    }
+
+    return fd;
+}
+
+static PyObject *
+
+custom4_dump(PyObject *module, PyObject *args)
+{
+    PyObject *objs, *path, *res;
+    CustomArrayObject *array;
+    CustomDumpHeader header = {{'C', 'U', 'S', '4'}, CUSTOM_DUMP_VERSION, 0x0102, sizeof(Py_ssize_t), 0, 0, 0, 0, 0};
+    CustomChecksum sum = {0, 0};
+    const void *data[6];
+    size_t size[6], total, tmp_size;
+    char *copy = NULL, *tmp, *p;
+    unsigned int serial;
+    int fd, i, count, failed, saved_errno = 0;
+
+    if (!PyArg_ParseTuple(args, "OO&:dump", &objs, PyUnicode_FSConverter, &path))
+        return NULL;
+
+    if (PyObject_TypeCheck(objs, &CustomArrayType)) {
+        array = (CustomArrayObject *) objs;
+        Py_INCREF(array);
+    }
+    else {
+        array = (CustomArrayObject *) CustomArrayType.tp_alloc(&CustomArrayType, 0);
+
+        if (array == NULL || (res = CustomArray_extend(array, objs)) == NULL) {
+            Py_XDECREF(array);
+            Py_DECREF(path);
+
+            return NULL;
+        }
+
+        Py_DECREF(res);
+    }
+
+    tmp_size = (size_t) PyBytes_GET_SIZE(path) + 64;
+    tmp = PyMem_Malloc(tmp_size);
+
+    if (tmp == NULL) {
+        PyErr_NoMemory();
+        Py_DECREF(array);
+        Py_DECREF(path);
+
+        return NULL;
+    }
+
+    serial = Custom_dump_serial++;
+
+    count = Custom_dump_sections(array, data, size);
+
+    header.count = (uint64_t) array->length;
+    header.first_size = (uint64_t) array->first.size;
+    header.last_size = (uint64_t) array->last.size;
+
+    if ((PyObject *) array == objs) {
+        for (i = 0, total = 0; i < count; i++)
+            total += size[i];
+
+        copy = PyMem_Malloc(total + 1);
+
+        if (copy == NULL) {
+            PyErr_NoMemory();
+            PyMem_Free(tmp);
+            Py_DECREF(array);
+            Py_DECREF(path);
+
+            return NULL;
+        }
+
+        for (i = 0, p = copy; i < count; p += size[i], i++) {
+            if (size[i] > 0)
+                memcpy(p, data[i], size[i]);
+
+            data[i] = p;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+
+    for (i = 0; i < count; i++)
+        CustomChecksum_update(&sum, data[i], size[i]);
+
+    header.checksum = sum.a ^ (sum.b << 1);
+
+    fd = Custom_open_temp(PyBytes_AS_STRING(path), tmp, tmp_size, serial);
+    failed = fd < 0 || Custom_write_all(fd, &header, sizeof(header)) < 0;
+
+    for (i = 0; !failed && i < count; i++)
+        failed = Custom_write_all(fd, data[i], size[i]) < 0;
+
+    if (failed)
+        saved_errno = errno;
+
+    if (fd >= 0 && close(fd) < 0 && !failed) {
+        failed = 1;
+        saved_errno = errno;
+    }
+
+    if (!failed && rename(tmp, PyBytes_AS_STRING(path)) < 0) {
+        failed = 1;
+        saved_errno = errno;
+    }
+
+    if (failed && fd >= 0)
+        unlink(tmp);
+
+    Py_END_ALLOW_THREADS
+
+    if (failed) {
+        errno = saved_errno;
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyBytes_AS_STRING(path));
+    }
+
+    PyMem_Free(copy);
+    PyMem_Free(tmp);
+    Py_DECREF(array);
+    Py_DECREF(path);
+
+    if (failed)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+/* Check that the offsets of a column are in order and stay inside its text */
+
+static int
+
+CustomStrColumn_check(CustomStrColumn *col, Py_ssize_t n)
+{
+    Py_ssize_t i, prev = 0;
+
+    for (i = 0; i < n; i++) {
+        if (col->end[i] < prev)
+            return -1;
+
+        prev = col->end[i];
+    }
+
+    return (prev == col->size) ? 0 : -1;
+}
+
+static PyObject *
+
+custom4_load(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"path", "mmap", "verify", NULL};
+
+    PyObject *path;
+    CustomArrayObject *array;
+    CustomDumpHeader header;
+    CustomChecksum sum = {0, 0};
+    const void *data[6];
+    size_t size[6], total;
+    struct stat st;
+    int use_mmap = 0, verify = 1, fd, i, count, failed = 0;
+    const char *corrupt = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&|pp:load", kwlist,
+                                     PyUnicode_FSConverter, &path, &use_mmap, &verify))
+        return NULL;
+
+    array = (CustomArrayObject *) CustomArrayType.tp_alloc(&CustomArrayType, 0);
+
+    if (array == NULL) {
+        Py_DECREF(path);
+
+        return NULL;
+    }
+
+    fd = open(PyBytes_AS_STRING(path), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || fstat(fd, &st) < 0 || Custom_read_all(fd, &header, sizeof(header)) < 0)
+        goto error;
+
+    if (memcmp(header.magic, "CUS4", 4) != 0)
+        corrupt = "not a custom4 dump file";
+    else if (header.version != CUSTOM_DUMP_VERSION)
+        corrupt = "unsupported custom4 dump format version";
+    else if (header.byte_order != 0x0102 || header.offset_size != sizeof(Py_ssize_t))
+        corrupt = "custom4 dump file written with a different byte order or word size";
+    else if (header.count > PY_SSIZE_T_MAX / sizeof(Py_ssize_t) / 4 ||
+             header.first_size > PY_SSIZE_T_MAX / 4 || header.last_size > PY_SSIZE_T_MAX / 4)
+        corrupt = "custom4 dump file is damaged";
+
+    if (corrupt != NULL)
+        goto corrupted;
+
+    array->length = array->allocated = (Py_ssize_t) header.count;
+    array->first.size = (Py_ssize_t) header.first_size;
+    array->last.size = (Py_ssize_t) header.last_size;
+
+    count = Custom_dump_sections(array, data, size);
+
+    for (i = 0, total = sizeof(header); i < count; i++)
+        total += size[i];
+
+    if ((uint64_t) st.st_size != total) {
+        corrupt = "custom4 dump file is truncated or damaged";
+
+        goto corrupted;
+    }
+
+    if (use_mmap) {
+        char *p = mmap(NULL, total, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (p == MAP_FAILED)
+            goto error;
+
+        array->mapping = p;
+        array->mapping_size = total;
+
+        p += sizeof(header);
+        array->first.end = (Py_ssize_t *) p;  p += size[0];
+        array->last.end = (Py_ssize_t *) p;   p += size[1];
+        array->number = (int *) p;            p += size[2] + size[3];
+        array->first.data = p;                p += size[4];
+        array->last.data = p;
+    }
+    else {
+        char pad[8];
+
+        array->first.end = PyMem_Malloc(size[0] + 1);
+        array->last.end = PyMem_Malloc(size[1] + 1);
+        array->number = PyMem_Malloc(size[2] + 1);
+        array->first.data = PyMem_Malloc(size[4] + 1);
+        array->last.data = PyMem_Malloc(size[5] + 1);
+
+        if (array->first.end == NULL || array->last.end == NULL || array->number == NULL ||
+            array->first.data == NULL || array->last.data == NULL) {
+            PyErr_NoMemory();
+
+            goto failed;
+        }
+
+        array->first.allocated = array->first.size;
+        array->last.allocated = array->last.size;
+
+        Py_BEGIN_ALLOW_THREADS
+        failed = Custom_read_all(fd, array->first.end, size[0]) < 0 ||
+                 Custom_read_all(fd, array->last.end, size[1]) < 0 ||
+                 Custom_read_all(fd, array->number, size[2]) < 0 ||
+                 Custom_read_all(fd, pad, size[3]) < 0 ||
+                 Custom_read_all(fd, array->first.data, size[4]) < 0 ||
+                 Custom_read_all(fd, array->last.data, size[5]) < 0;
+        Py_END_ALLOW_THREADS
+
+        if (failed)
+            goto error;
+    }
+
+    close(fd);
+    fd = -1;
+
+    count = Custom_dump_sections(array, data, size);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (verify) {
+        for (i = 0; i < count; i++)
+            CustomChecksum_update(&sum, data[i], size[i]);
+    }
+
+    failed = CustomStrColumn_check(&array->first, array->length) < 0 ||
+             CustomStrColumn_check(&array->last, array->length) < 0;
+    Py_END_ALLOW_THREADS
+
+    if (verify && header.checksum != (sum.a ^ (sum.b << 1)))
+        corrupt = "custom4 dump file checksum mismatch";
+    else if (failed)
+        corrupt = "custom4 dump file is damaged";
+
+    if (corrupt != NULL)
+        goto corrupted;
+
+    Py_DECREF(path);
+
+    return (PyObject *) array;
+
+corrupted:
+    PyErr_Format(PyExc_ValueError, "%s: %s", corrupt, PyBytes_AS_STRING(path));
+
+    goto failed;
+
+error:
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, PyBytes_AS_STRING(path));
+
+failed:
+    if (fd >= 0)
+        close(fd);
+
+    Py_DECREF(array);
+    Py_DECREF(path);
+
+    return NULL;
+}
+
+/* Give a loaded array columns of its own before it is changed */
+
+static int
+
+CustomArray_unmap(CustomArrayObject *self)
+{
+    size_t n = (size_t) self->length;
+    int *number = PyMem_Malloc(n * sizeof(int) + 1);
+    Py_ssize_t *first_end = PyMem_Malloc(n * sizeof(Py_ssize_t) + 1);
+    Py_ssize_t *last_end = PyMem_Malloc(n * sizeof(Py_ssize_t) + 1);
+    char *first_data = PyMem_Malloc(self->first.size + 1);
+    char *last_data = PyMem_Malloc(self->last.size + 1);
+
+    if (number == NULL || first_end == NULL || last_end == NULL || first_data == NULL || last_data == NULL) {
+        PyMem_Free(number);
+        PyMem_Free(first_end);
+        PyMem_Free(last_end);
+        PyMem_Free(first_data);
+        PyMem_Free(last_data);
+
+        PyErr_NoMemory();
+
+        return -1;
+    }
+
+    memcpy(number, self->number, n * sizeof(int));
+    memcpy(first_end, self->first.end, n * sizeof(Py_ssize_t));
+    memcpy(last_end, self->last.end, n * sizeof(Py_ssize_t));
+    memcpy(first_data, self->first.data, self->first.size);
+    memcpy(last_data, self->last.data, self->last.size);
+
+    munmap(self->mapping, self->mapping_size);
+    self->mapping = NULL;
+
+    self->number = number;
+    self->first.end = first_end;
+    self->last.end = last_end;
+    self->first.data = first_data;
+    self->last.data = last_data;
+    self->first.allocated = self->first.size;
+    self->last.allocated = self->last.size;
+
+    return 0;
+}
+
+/*
+ Sorting Custom objects:
+ sorted(objs, key=lambda c: (c.last, c.first, c.number)) builds a tuple for every object and compares the tuples element by element through the
+ generic comparison machinery.
+ custom4.sort(objs, keys=("last", "first", "number"), reverse=False, parallel=True) returns a new list sorted by the given fields with the same
+ result, including the order of equal objects, but extracts the keys in C.
+ The sort works on an array of 16-byte items, each holding a key and the position of the object, and sorts it once per field, starting with the last
+ one; since every pass is stable, the array ends up ordered by all fields.
+ All passes are LSD radix sorts over the bytes of the keys, which skip the bytes that are the same for all items:
+ - For number the key is the value itself.
+ - For first and last the key holds the first 7 bytes of the UTF-8 text (UTF-8 byte order is code point order, the order of str), and groups of names
+   that are still tied are sorted again on their next 7 bytes; groups that stay tied after a few rounds, or are small, are merge sorted by comparing
+   the text.
+   Names that repeat many times thus cost a few passes over the array instead of a comparison of the full text with every neighbour.
+ The names are collected while holding the GIL, keeping references to the strings; the passes then run with the GIL released.
+ With parallel=True a pass over the names of at least CUSTOM_SORT_PARALLEL_MIN objects sorts up to CUSTOM_SORT_THREADS slices in separate threads and
+ merges them pairwise, again in parallel.
+*/
+
+#include <pthread.h>
+
+#ifndef CUSTOM_SORT_THREADS
+#define CUSTOM_SORT_THREADS 4
+#endif
+
+#define CUSTOM_SORT_PARALLEL_MIN 65536
+
+typedef struct {
+    const char *text[2];    /* UTF-8 of first and last */
+    Py_ssize_t size[2];
+} CustomSortNames;
+
+typedef struct {
+    uint64_t key;
+    Py_ssize_t index;
+} CustomSortItem;
+
+typedef struct {
+    const CustomSortNames *names;
+    int field;              /* 0 for first, 1 for last */
+    int reverse;
+} CustomSortContext;
+
+/* Compare the names of two items as str objects would */
+
+static inline int
+
+CustomSort_less(const CustomSortItem *a, const CustomSortItem *b, const CustomSortContext *ctx)
+{
+    const CustomSortNames *x = &ctx->names[a->index], *y = &ctx->names[b->index];
+    Py_ssize_t xsize = x->size[ctx->field], ysize = y->size[ctx->field];
+    int cmp = memcmp(x->text[ctx->field], y->text[ctx->field], Py_MIN(xsize, ysize));
+
+    if (cmp == 0)
+        cmp = (xsize > ysize) - (xsize < ysize);
+
+    return ctx->reverse ? cmp > 0 : cmp < 0;
+}
+
+/* Merge the sorted runs a[0:mid] and a[mid:n], using tmp for a copy of the first run */
+
+static void
+
+CustomSort_merge(CustomSortItem *a, CustomSortItem *tmp, Py_ssize_t mid, Py_ssize_t n, const CustomSortContext *ctx)
+{
+    Py_ssize_t i = 0, j = mid, k = 0;
+
+    if (mid == 0 || mid == n || !CustomSort_less(&a[mid], &a[mid - 1], ctx))
+        return;
+
+    memcpy(tmp, a, mid * sizeof(CustomSortItem));
+
+    while (i < mid && j < n) {
+        if (CustomSort_less(&a[j], &tmp[i], ctx))
+            a[k++] = a[j++];
+        else
+            a[k++] = tmp[i++];
+    }
+
+    while (i < mid)
+        a[k++] = tmp[i++];
+}
+
+static void
+
+CustomSort_msort(CustomSortItem *a, CustomSortItem *tmp, Py_ssize_t n, const CustomSortContext *ctx)
+{
+    Py_ssize_t i, j;
+
+    if (n <= 24) {
+        for (i = 1; i < n; i++) {
+            CustomSortItem item = a[i];
+
+            for (j = i; j > 0 && CustomSort_less(&item, &a[j - 1], ctx); j--)
+                a[j] = a[j - 1];
+
+            a[j] = item;
+        }
+
+        return;
+    }
+
+    CustomSort_msort(a, tmp, n / 2, ctx);
+    CustomSort_msort(a + n / 2, tmp + n / 2, n - n / 2, ctx);
+    CustomSort_merge(a, tmp, n / 2, n, ctx);
+}
+
+/* Stable LSD radix sort on the keys, skipping the bytes that are the same for all items */
+
+static void
+
+CustomSort_radix(CustomSortItem *a, CustomSortItem *tmp, Py_ssize_t n)
+{
+    Py_ssize_t counts[8][256];
+    CustomSortItem *src = a, *dst = tmp, *swap;
+    Py_ssize_t i;
+    int pass, b;
+
+    memset(counts, 0, sizeof(counts));
+
+    for (i = 0; i < n; i++) {
+        for (pass = 0; pass < 8; pass++)
+            counts[pass][(a[i].key >> (8 * pass)) & 0xff]++;
+    }
+
+    for (pass = 0; pass < 8; pass++) {
+        Py_ssize_t offset = 0, *count = counts[pass];
+        int shift = 8 * pass;
+
+        if (count[(a[0].key >> shift) & 0xff] == n)
+            continue;
+
+        for (b = 0; b < 256; b++) {
+            Py_ssize_t c = count[b];
+
+            count[b] = offset;
+            offset += c;
+        }
+
+        for (i = 0; i < n; i++)
+            dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != a)
+        memcpy(a, src, n * sizeof(CustomSortItem));
+}
+
+/*
+ The key of a string for chunk c holds its bytes 7c to 7c + 6 in big-endian order followed by the number of bytes left from 7c on, or 255 if more
+ than 7 are left, so that a string sorts before any longer string it is a prefix of.
+ Two keys of the same chunk that are equal and do not end in 255 belong to equal strings.
+*/
+
+#define CUSTOM_SORT_MORE 0xff
+
+static inline uint64_t
+
+CustomSort_chunk(const char *text, Py_ssize_t size, Py_ssize_t offset)
+{
+    Py_ssize_t left = size - offset, i;
+    uint64_t key = 0;
+
+    for (i = 0; i < 7; i++)
+        key = (key << 8) | (i < left ? (unsigned char) text[offset + i] : 0);
+
+    return (key << 8) | (left > 7 ? CUSTOM_SORT_MORE : (uint64_t) left);
+}
+
+static void
+
+CustomSort_refine(CustomSortItem *a, CustomSortItem *tmp, Py_ssize_t n, const CustomSortContext *ctx, int depth)
+{
+    uint64_t flip = ctx->reverse ? ~(uint64_t) 0 : 0;
+    Py_ssize_t i, j;
+
+    /* Small groups, and names that are still equal after a few chunks, are sorted by comparing the text */
+
+    if (n <= 32 || depth >= 4) {
+        CustomSort_msort(a, tmp, n, ctx);
+
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        const CustomSortNames *name = &ctx->names[a[i].index];
+
+        a[i].key = CustomSort_chunk(name->text[ctx->field], name->size[ctx->field], 7 * depth) ^ flip;
+    }
+
+    CustomSort_radix(a, tmp, n);
+
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && a[j].key == a[i].key; j++)
+            ;
+
+        if (j - i > 1 && ((a[i].key ^ flip) & 0xff) == CUSTOM_SORT_MORE)
+            CustomSort_refine(a + i, tmp + i, j - i, ctx, depth + 1);
+    }
+}
+
+typedef struct {
+    CustomSortItem *a, *tmp;
+    Py_ssize_t mid, n;      /* mid < 0 sorts a[0:n], otherwise merges a[0:mid] and a[mid:n] */
+    const CustomSortContext *ctx;
+} CustomSortTask;
+
+static void *
+
+CustomSort_run(void *arg)
+{
+    CustomSortTask *task = arg;
+
+    if (task->mid < 0)
+        CustomSort_refine(task->a, task->tmp, task->n, task->ctx, 0);
+    else
+        CustomSort_merge(task->a, task->tmp, task->mid, task->n, task->ctx);
+
+    return NULL;
+}
+
+/* Run the tasks in threads of their own; a task whose thread cannot be started runs in the calling thread */
+
+static void
+
+CustomSort_run_all(CustomSortTask *tasks, int count)
+{
+    pthread_t threads[CUSTOM_SORT_THREADS];
+    int started[CUSTOM_SORT_THREADS], i;
+
+    for (i = 1; i < count; i++)
+        started[i] = pthread_create(&threads[i], NULL, CustomSort_run, &tasks[i]) == 0;
+
+    CustomSort_run(&tasks[0]);
+
+    for (i = 1; i < count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            CustomSort_run(&tasks[i]);
+    }
+}
+
+static void
+
+CustomSort_strings(CustomSortItem *a, CustomSortItem *tmp, Py_ssize_t n, const CustomSortContext *ctx, int parallel)
+{
+    CustomSortTask tasks[CUSTOM_SORT_THREADS];
+    Py_ssize_t bounds[CUSTOM_SORT_THREADS + 1];
+    int slices = 1, width, i;
+
+    if (parallel && n >= CUSTOM_SORT_PARALLEL_MIN) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        while (slices * 2 <= CUSTOM_SORT_THREADS && slices * 2 <= cpus)
+            slices *= 2;
+    }
+
+    if (slices == 1) {
+        CustomSort_refine(a, tmp, n, ctx, 0);
+
+        return;
+    }
+
+    for (i = 0; i <= slices; i++)
+        bounds[i] = n / slices * i + Py_MIN(i, n % slices);
+
+    for (i = 0; i < slices; i++)
+        tasks[i] = (CustomSortTask) {a + bounds[i], tmp + bounds[i], -1, bounds[i + 1] - bounds[i], ctx};
+
+    CustomSort_run_all(tasks, slices);
+
+    for (width = 1; width < slices; width *= 2) {
+        int count = 0;
+
+        for (i = 0; i + width < slices; i += 2 * width) {
+            Py_ssize_t lo = bounds[i], hi = bounds[Py_MIN(i + 2 * width, slices)];
+
+            tasks[count++] = (CustomSortTask) {a + lo, tmp + lo, bounds[i + width] - lo, hi - lo, ctx};
+        }
+
+        CustomSort_run_all(tasks, count);
+    }
+}
+
+static PyObject *
+
+custom4_sort(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"objs", "keys", "reverse", "parallel", NULL};
+    static const char *const field_names[] = {"first", "last", "number"};
+
+    PyObject *objs, *keys = NULL, *seq = NULL, *keyseq = NULL, *result = NULL;
+    CustomSortNames *names = NULL;
+    CustomSortItem *items = NULL, *tmp = NULL;
+    CustomSortContext ctx;
+    Py_ssize_t n, i, nkeys;
+    int reverse = 0, parallel = 1, fields[8], k;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Opp:sort", kwlist, &objs, &keys, &reverse, &parallel))
+        return NULL;
+
+    if (keys == NULL)
+        keyseq = Py_BuildValue("(sss)", "last", "first", "number");
+    else if (PyUnicode_Check(keys))
+        keyseq = PyTuple_Pack(1, keys);
+    else
+        keyseq = PySequence_Fast(keys, "keys must be a sequence of field names");
+
+    if (keyseq == NULL)
+        return NULL;
+
+    nkeys = PySequence_Fast_GET_SIZE(keyseq);
+
+    if (nkeys == 0 || nkeys > 8) {
+        PyErr_SetString(PyExc_ValueError, "sort() needs between 1 and 8 keys");
+
+        goto done;
+    }
+
+    for (k = 0; k < nkeys; k++) {
+        PyObject *key = PySequence_Fast_GET_ITEM(keyseq, k);
+
+        for (fields[k] = 0; fields[k] < 3; fields[k]++) {
+            if (PyUnicode_Check(key) && PyUnicode_CompareWithASCIIString(key, field_names[fields[k]]) == 0)
+                break;
+        }
+
+        if (fields[k] == 3) {
+            PyErr_Format(PyExc_ValueError, "unknown sort key %R, expected 'first', 'last' or 'number'", key);
+
+            goto done;
+        }
+    }
+
+    if ((seq = PySequence_Fast(objs, "sort() expects a sequence of Custom objects")) == NULL)
+        goto done;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+
+    /* Keep the list alive and our references to the names, whatever happens to the objects meanwhile */
+
+    if ((result = PyList_New(n)) == NULL)
+        goto done;
+
+    names = PyMem_Calloc(n + 1, sizeof(CustomSortNames));
+    items = PyMem_Malloc((n + 1) * sizeof(CustomSortItem));
+    tmp = PyMem_Malloc((n + 1) * sizeof(CustomSortItem));
+
+    if (names == NULL || items == NULL || tmp == NULL) {
+        PyErr_NoMemory();
+
+        goto error;
+    }
+
+    for (i = 0; i < n; i++) {
+        CustomObject *obj = (CustomObject *) PySequence_Fast_GET_ITEM(seq, i);
+        int f;
+
+        if (!PyObject_TypeCheck(obj, &CustomType)) {
+            PyErr_Format(PyExc_TypeError, "sort() expects Custom objects, not %.50s", Py_TYPE(obj)->tp_name);
+
+            goto error;
+        }
+
+        if (Custom_materialize(obj) < 0)
+            goto error;
+
+        Py_INCREF(obj);
+        PyList_SET_ITEM(result, i, (PyObject *) obj);
+
+        for (f = 0; f < 2; f++) {
+            PyObject *name = (f == 0) ? obj->first : obj->last;
+
+            if ((names[i].text[f] = PyUnicode_AsUTF8AndSize(name, &names[i].size[f])) == NULL)
+                goto error;
+        }
+
+        items[i].index = i;
+    }
+
+    /* The names must outlive the sort even if a setter replaces them in another thread */
+
+    for (i = 0; i < n; i++) {
+        Py_INCREF(((CustomObject *) PyList_GET_ITEM(result, i))->first);
+        Py_INCREF(((CustomObject *) PyList_GET_ITEM(result, i))->last);
+    }
+
+    ctx.names = names;
+    ctx.reverse = reverse;
+
+    for (k = (int) nkeys - 1; k >= 0; k--) {
+        CustomObject **obj = (CustomObject **) PySequence_Fast_ITEMS(result);
+
+        if (fields[k] == 2) {
+            for (i = 0; i < n; i++) {
+                uint32_t key = (uint32_t) obj[items[i].index]->number ^ 0x80000000u;
+
+                items[i].key = reverse ? (uint32_t) ~key : key;
+            }
+        }
+
+        ctx.field = fields[k];
+
+        Py_BEGIN_ALLOW_THREADS
+        if (n > 1) {
+            if (fields[k] == 2)
+                CustomSort_radix(items, tmp, n);
+            else
+                CustomSort_strings(items, tmp, n, &ctx, parallel);
+        }
+        Py_END_ALLOW_THREADS
+    }
+
+    for (i = 0; i < n; i++) {
+        Py_DECREF(((CustomObject *) PyList_GET_ITEM(result, i))->first);
+        Py_DECREF(((CustomObject *) PyList_GET_ITEM(result, i))->last);
+    }
+
+    /* Reorder the list by the sorted positions; tmp is reused as scratch for the objects */
+
+    if (n > 0) {
+        PyObject **out = (PyObject **) tmp, **in = PySequence_Fast_ITEMS(result);
+
+        for (i = 0; i < n; i++)
+            out[i] = in[items[i].index];
+
+        memcpy(in, out, n * sizeof(PyObject *));
+    }
+
+    goto done;
+
+error:
+    Py_CLEAR(result);
+
+done:
+    PyMem_Free(names);
+    PyMem_Free(items);
+    PyMem_Free(tmp);
+
+    Py_XDECREF(seq);
+    Py_XDECREF(keyseq);
+
+    return result;
+}
+
+/*
+ Selecting the largest numbers:
+ heapq.nlargest(k, objs, key=lambda c: c.number) calls the key function for every object and compares Python ints.
+ custom4.topk(objs, k, key="number") returns the k objects with the largest number, largest first, in the same order as nlargest() (of equal numbers,
+ the earlier object comes first); objs is a sequence of Custom objects or a CustomArray, whose rows are returned as new Custom objects.
+ The numbers are scanned from a contiguous int array, the column of a CustomArray or a copy gathered from the objects, while a heap of size k keeps the
+ best k seen so far with the worst of them on top.
+ Once the heap is full, almost every number is smaller than that worst one, so the scan tests blocks of CUSTOM_TOPK_BLOCK numbers against it with a
+ loop the compiler turns into SIMD comparisons, and looks at the numbers one by one only in blocks that contain a candidate.
+*/
+
+#define CUSTOM_TOPK_BLOCK 16
+
+typedef struct {
+    int number;
+    Py_ssize_t index;
+} CustomTopItem;
+
+/* Is a worse than b?  Smaller numbers are worse, and of equal numbers the later one */
+
+static inline int
+
+CustomTop_worse(const CustomTopItem *a, const CustomTopItem *b)
+{
+    return a->number < b->number || (a->number == b->number && a->index > b->index);
+}
+
+static void
+
+CustomTop_sift_down(CustomTopItem *heap, Py_ssize_t k, Py_ssize_t i)
+{
+    CustomTopItem item = heap[i];
+
+    for (;;) {
+        Py_ssize_t child = 2 * i + 1;
+
+        if (child >= k)
+            break;
+
+        if (child + 1 < k && CustomTop_worse(&heap[child + 1], &heap[child]))
+            child++;
+
+        if (!CustomTop_worse(&heap[child], &item))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = item;
+}
+
+/* Fill heap with the k best of numbers[0:n], k <= n, and sort it best first */
+
+static void
+
+CustomTop_select(const int *numbers, Py_ssize_t n, CustomTopItem *heap, Py_ssize_t k)
+{
+    Py_ssize_t i, j;
+    int worst;
+
+    for (i = 0; i < k; i++)
+        heap[i] = (CustomTopItem) {numbers[i], i};
+
+    for (i = k / 2; i-- > 0;)
+        CustomTop_sift_down(heap, k, i);
+
+    worst = heap[0].number;
+    i = k;
+
+    while (i < n) {
+        if (i + CUSTOM_TOPK_BLOCK <= n) {
+            int candidates = 0;
+
+            for (j = 0; j < CUSTOM_TOPK_BLOCK; j++)
+                candidates |= numbers[i + j] > worst;
+
+            if (!candidates) {
+                i += CUSTOM_TOPK_BLOCK;
+
+                continue;
+            }
+        }
+
+        for (j = i + Py_MIN(CUSTOM_TOPK_BLOCK, n - i); i < j; i++) {
+            if (numbers[i] > worst) {
+                heap[0] = (CustomTopItem) {numbers[i], i};
+                CustomTop_sift_down(heap, k, 0);
+                worst = heap[0].number;
+            }
+        }
+    }
+
+    /* Heapsort: moving the worst item to the end each time leaves the best first */
+
+    for (i = k - 1; i > 0; i--) {
+        CustomTopItem item = heap[0];
+
+        heap[0] = heap[i];
+        heap[i] = item;
+        CustomTop_sift_down(heap, i, 0);
+    }
+}
+
+static PyObject *
+
+custom4_topk(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"objs", "k", "key", NULL};
+
+    PyObject *objs, *seq = NULL, *result = NULL;
+    const char *key = "number";
+    CustomArrayObject *array = NULL;
+    CustomTopItem *heap = NULL;
+    int *numbers = NULL;
+    Py_ssize_t k, n, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "On|s:topk", kwlist, &objs, &k, &key))
+        return NULL;
+
+    if (strcmp(key, "number") != 0) {
+        PyErr_Format(PyExc_ValueError, "topk() can only select by 'number', not '%s'", key);
+
+        return NULL;
+    }
+
+    if (PyObject_TypeCheck(objs, &CustomArrayType)) {
+        array = (CustomArrayObject *) objs;
+        n = array->length;
+        numbers = array->number;
+    }
+    else {
+        if ((seq = PySequence_Fast(objs, "topk() expects a sequence of Custom objects or a CustomArray")) == NULL)
+            return NULL;
+
+        n = PySequence_Fast_GET_SIZE(seq);
+
+        if ((numbers = PyMem_Malloc(n * sizeof(int) + 1)) == NULL) {
+            PyErr_NoMemory();
+
+            goto done;
+        }
+
+        for (i = 0; i < n; i++) {
+            PyObject *obj = PySequence_Fast_GET_ITEM(seq, i);
+
+            if (!PyObject_TypeCheck(obj, &CustomType)) {
+                PyErr_Format(PyExc_TypeError, "topk() expects Custom objects, not %.50s", Py_TYPE(obj)->tp_name);
+
+                goto done;
+            }
+
+            numbers[i] = ((CustomObject *) obj)->number;
+        }
+    }
+
+    k = Py_MAX(0, Py_MIN(k, n));
+
+    if ((heap = PyMem_Malloc(k * sizeof(CustomTopItem) + 1)) == NULL) {
+        PyErr_NoMemory();
+
+        goto done;
+    }
+
+    if (k > 0)
+        CustomTop_select(numbers, n, heap, k);
+
+    if ((result = PyList_New(k)) == NULL)
+        goto done;
+
+    for (i = 0; i < k; i++) {
+        PyObject *obj;
+
+        if (array != NULL)
+            obj = CustomArray_item(array, heap[i].index);
+        else {
+            obj = PySequence_Fast_GET_ITEM(seq, heap[i].index);
+            Py_INCREF(obj);
+        }
+
+        if (obj == NULL) {
+            Py_CLEAR(result);
+
+            goto done;
+        }
+
+        PyList_SET_ITEM(result, i, obj);
+    }
+
+done:
+    if (array == NULL)
+        PyMem_Free(numbers);
+
+    PyMem_Free(heap);
+    Py_XDECREF(seq);
+
+    return result;
+}
+
+/*
+ Reading and writing one field of many objects:
+ custom4.gather(objs, field) returns the field of every object: for "number" a memoryview of C ints over a new bytearray, which NumPy and the array
+ module accept as a buffer, and for "first" or "last" a list of the str objects.
+ custom4.scatter(objs, field, values) is the reverse; values is a sequence, or for "number" also a one-dimensional buffer of C integers as accepted by
+ Custom.from_columns().
+ scatter() checks the objects, the values and their ranges for the whole batch before it changes anything, so it either updates every object or none.
+ The objects are scattered over the heap, so both loops prefetch the object CUSTOM_PREFETCH_AHEAD positions ahead of the one they work on.
+*/
+
+#define CUSTOM_PREFETCH_AHEAD 8
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CUSTOM_PREFETCH(p, rw) __builtin_prefetch((p), (rw))
+#else
+#define CUSTOM_PREFETCH(p, rw) ((void) 0)
+#endif
+
+/* Return 0, 1 or 2 for "first", "last" or "number" */
+
+static int
+
+Custom_field_index(const char *field)
+{
+    static const char *const fields[] = {"first", "last", "number"};
+
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (strcmp(field, fields[i]) == 0)
+            return i;
+    }
+
+    PyErr_Format(PyExc_ValueError, "unknown field '%s', expected 'first', 'last' or 'number'", field);
+
+    return -1;
+}
+
+/* Check that every item of a sequence is a Custom object */
+
+static int
+
+Custom_check_objects(PyObject *seq, const char *func)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        PyObject *obj = PySequence_Fast_GET_ITEM(seq, i);
+
+        if (!PyObject_TypeCheck(obj, &CustomType)) {
+            PyErr_Format(PyExc_TypeError, "%s() expects Custom objects, not %.50s", func, Py_TYPE(obj)->tp_name);
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static PyObject *
+
+custom4_gather(PyObject *module, PyObject *args)
+{
+    PyObject *objs, *seq, *result = NULL, *bytes, *view;
+    CustomObject **items;
+    const char *field;
+    Py_ssize_t n, i;
+    int f;
+
+    if (!PyArg_ParseTuple(args, "Os:gather", &objs, &field) || (f = Custom_field_index(field)) < 0)
+        return NULL;
+
+    if ((seq = PySequence_Fast(objs, "gather() expects a sequence of Custom objects")) == NULL)
+        return NULL;
+
+    if (Custom_check_objects(seq, "gather") < 0)
+        goto done;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    items = (CustomObject **) PySequence_Fast_ITEMS(seq);
+
+    if (f == 2) {
+        int *numbers;
+
+        if ((bytes = PyByteArray_FromStringAndSize(NULL, n * sizeof(int))) == NULL)
+            goto done;
+
+        numbers = (int *) PyByteArray_AS_STRING(bytes);
+
+        for (i = 0; i < n; i++) {
+            if (i + CUSTOM_PREFETCH_AHEAD < n)
+                CUSTOM_PREFETCH(items[i + CUSTOM_PREFETCH_AHEAD], 0);
+
+            numbers[i] = items[i]->number;
+        }
+
+        view = PyMemoryView_FromObject(bytes);
+        Py_DECREF(bytes);
+
+        if (view == NULL)
+            goto done;
+
+        result = PyObject_CallMethod(view, "cast", "s", "i");
+        Py_DECREF(view);
+    }
+    else {
+        if ((result = PyList_New(n)) == NULL)
+            goto done;
+
+        for (i = 0; i < n; i++) {
+            PyObject *name;
+
+            if (i + CUSTOM_PREFETCH_AHEAD < n)
+                CUSTOM_PREFETCH(items[i + CUSTOM_PREFETCH_AHEAD], 0);
+
+            if (Custom_materialize(items[i]) < 0) {
+                Py_CLEAR(result);
+
+                goto done;
+            }
+
+            name = (f == 0) ? items[i]->first : items[i]->last;
+            Py_INCREF(name);
+            PyList_SET_ITEM(result, i, name);
+        }
+    }
+
+done:
+    Py_DECREF(seq);
+
+    return result;
+}
+
+static PyObject *
+
+custom4_scatter(PyObject *module, PyObject *args)
+{
+    PyObject *objs, *values, *seq, *vals = NULL, *result = NULL, **strings = NULL;
+    Py_buffer view = {NULL};
+    CustomObject **items;
+    const char *field;
+    Py_ssize_t n, i, nstrings = 0;
+    int *numbers = NULL, f;
+
+    if (!PyArg_ParseTuple(args, "OsO:scatter", &objs, &field, &values) || (f = Custom_field_index(field)) < 0)
+        return NULL;
+
+    if ((seq = PySequence_Fast(objs, "scatter() expects a sequence of Custom objects")) == NULL)
+        return NULL;
+
+    if (Custom_check_objects(seq, "scatter") < 0)
+        goto done;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    items = (CustomObject **) PySequence_Fast_ITEMS(seq);
+
+    if (f == 2 && PyObject_CheckBuffer(values)) {
+        if (PyObject_GetBuffer(values, &view, PyBUF_FORMAT | PyBUF_ND) < 0 || Custom_column_format(&view) < 0)
+            goto done;
+
+        if (view.shape[0] != n)
+            goto length;
+    }
+    else {
+        if ((vals = PySequence_Fast(values, "scatter() expects a sequence of values")) == NULL)
+            goto done;
+
+        if (PySequence_Fast_GET_SIZE(vals) != n)
+            goto length;
+    }
+
+    /* Check and convert (or intern) every value first, so that a failure leaves all the objects unchanged */
+
+    if (f == 2) {
+        if ((numbers = PyMem_Malloc(n * sizeof(int) + 1)) == NULL) {
+            PyErr_NoMemory();
+
+            goto done;
+        }
+
+        for (i = 0; i < n; i++) {
+            long long number;
+
+            if (vals != NULL) {
+                PyObject *item = PySequence_Fast_GET_ITEM(vals, i);
+
+                if (PyFloat_Check(item)) {
+                    PyErr_Format(PyExc_TypeError, "item %zd: integer number expected, got float", i);
+
+                    goto done;
+                }
+
+                number = PyLong_AsLongLong(item);
+
+                if (number == -1 && PyErr_Occurred())
+                    goto done;
+            }
+            else
+                number = Custom_column_item(&view, i);
+
+            if (number > INT_MAX || number < INT_MIN) {
+                PyErr_Format(PyExc_OverflowError, "item %zd: number does not fit in a C int", i);
+
+                goto done;
+            }
+
+            numbers[i] = (int) number;
+        }
+    }
+    else {
+        if ((strings = PyMem_Malloc(n * sizeof(PyObject *) + 1)) == NULL) {
+            PyErr_NoMemory();
+
+            goto done;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (!PyUnicode_Check(PySequence_Fast_GET_ITEM(vals, i))) {
+                PyErr_Format(PyExc_TypeError, "item %zd: the %s attribute value must be a string", i, field);
+
+                goto done;
+            }
+
+            if (Custom_materialize(items[i]) < 0 || (strings[i] = Custom_intern(PySequence_Fast_GET_ITEM(vals, i))) == NULL)
+                goto done;
+
+            nstrings++;
+        }
+    }
+
+    /* Then store them; nothing below can fail */
+
+    for (i = 0; i < n; i++) {
+        CustomObject *self = items[i];
+        PyObject *value, **slot;
+
+        if (i + CUSTOM_PREFETCH_AHEAD < n)
+            CUSTOM_PREFETCH(items[i + CUSTOM_PREFETCH_AHEAD], 1);
+
+        if (f == 2) {
+            self->number = numbers[i];
+
+            continue;
+        }
+
+        value = strings[i];
+        slot = (f == 0) ? &self->first : &self->last;
+        Py_SETREF(*slot, value);
+        Custom_INVALIDATE(self);
+        Custom_maybe_track(self);
+    }
+
+    /* The objects own the strings now */
+
+    nstrings = 0;
+
+    result = Py_None;
+    Py_INCREF(result);
+
+    goto done;
+
+length:
+    PyErr_SetString(PyExc_ValueError, "scatter() needs as many values as objects");
+
+done:
+    if (view.obj != NULL)
+        PyBuffer_Release(&view);
+
+    for (i = 0; i < nstrings; i++)
+        Py_DECREF(strings[i]);
+
+    PyMem_Free(strings);
+    PyMem_Free(numbers);
+    Py_XDECREF(vals);
+    Py_DECREF(seq);
+
+    return result;
+}
+
+static PyMethodDef custom4_methods[] = {
+    {"set_freelist_cap", (PyCFunction) custom4_set_freelist_cap, METH_O,
+     "Set the number of free Custom objects kept for reuse"
+    },
+    {"freelist_stats", (PyCFunction) custom4_freelist_stats, METH_NOARGS,
+     "Return the hits, misses, size and cap of the Custom freelist"
+    },
+    {"set_intern_pool", (PyCFunction) custom4_set_intern_pool, METH_O,
+     "Enable the first/last name interning pool with room for n strings, or disable it with 0"
+    },
+    {"intern_stats", (PyCFunction) custom4_intern_stats, METH_NOARGS,
+     "Return the hits, misses, evictions, size and cap of the interning pool"
+    },
+    {"dump", (PyCFunction) custom4_dump, METH_VARARGS,
+     "Write Custom objects or a CustomArray to a file"
+    },
+    {"load", (PyCFunction)(void(*)(void)) custom4_load, METH_VARARGS | METH_KEYWORDS,
+     "Read a file written by dump() into a CustomArray"
+    },
+    {"sort", (PyCFunction)(void(*)(void)) custom4_sort, METH_VARARGS | METH_KEYWORDS,
+     "Return a new list of Custom objects sorted by the given fields"
+    },
+    {"topk", (PyCFunction)(void(*)(void)) custom4_topk, METH_VARARGS | METH_KEYWORDS,
+     "Return the k Custom objects with the largest number, largest first"
+    },
+    {"gather", (PyCFunction) custom4_gather, METH_VARARGS,
+     "Return one field of every Custom object, numbers as a buffer of C ints"
+    },
+    {"scatter", (PyCFunction) custom4_scatter, METH_VARARGS,
+     "Set one field of every Custom object from a sequence or buffer of values"
+    },
+    {"defer_tracking", (PyCFunction) custom4_defer_tracking, METH_O,
+     "Stop (True) or resume (False) tracking new Custom objects by the cyclic GC"
+    },
+    {NULL}  /* Sentinel */
+};
+
+static PyModuleDef custommodule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "custom4",
+    .m_doc = "Example module that creates an extension type.",
+    .m_size = -1,
+    .m_methods = custom4_methods,
+};
+
+PyMODINIT_FUNC
+
+PyInit_custom4(void)
+
+{
+    PyObject *m;
+
+    if (PyType_Ready(&CustomType) < 0)
+        return NULL;
+
+    if (PyType_Ready(&CustomArrayType) < 0)
+        return NULL;
+
+    Custom_empty = PyUnicode_New(0, 0);
+
+    if (Custom_empty == NULL)
+        return NULL;
+
+#if CUSTOM_VECTORCALL
+    Custom_kwnames[0] = PyUnicode_InternFromString("first");
+    Custom_kwnames[1] = PyUnicode_InternFromString("last");
+    Custom_kwnames[2] = PyUnicode_InternFromString("number");
+
+    if (Custom_kwnames[0] == NULL || Custom_kwnames[1] == NULL || Custom_kwnames[2] == NULL)
+        return NULL;
+#endif
+
+    m = PyModule_Create(&custommodule);
+
+    if (m == NULL)
+        return NULL;
+
+    Py_INCREF(&CustomType);
+    PyModule_AddObject(m, "Custom", (PyObject *) &CustomType);
+
+    Py_INCREF(&CustomArrayType);
+    PyModule_AddObject(m, "CustomArray", (PyObject *) &CustomArrayType);
 
     return m;
 
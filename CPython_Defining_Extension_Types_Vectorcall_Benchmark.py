@@ -0,0 +1,21 @@
+# CPython Defining Extension Types.
+# Benchmark for the vectorcall constructor of custom4.Custom.
+# Calling custom4.Custom goes through Custom_vectorcall(); a module built with -DCUSTOM_VECTORCALL=0 leaves tp_vectorcall empty, so the same type is
+# created by Custom_new() followed by Custom_init().
+# Run the script once against each build and compare the ns/object columns; both builds create the same objects, so the difference is the constructor
+# path.
+#
+
+import timeit
+
+import custom4
+
+N = 1000000
+
+for label, stmt in [
+    ("Custom('a', 'b', 1)", "Custom('a', 'b', 1)"),
+    ("Custom(first='a', last='b', number=1)", "Custom(first='a', last='b', number=1)"),
+    ("Custom()", "Custom()"),
+]:
+    seconds = min(timeit.repeat(stmt, globals={"Custom": custom4.Custom}, number=N, repeat=5))
+    print("%-40s %7.1f ns/object" % (label, seconds / N * 1e9))
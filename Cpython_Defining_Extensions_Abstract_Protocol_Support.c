@@ -59,6 +59,221 @@ newdatatype_hash(newdatatypeobject *obj)
  returning it when hash computation is successful, as seen above.
 */ 
 
+/*
+ Hashing the payload:
+ The example above only looks at two small integers, so objects that differ in their payload but not in those collide, and a dict or a set holding many
+ of them degrades into a linear search.
+ A hash that digests the whole payload avoids that.
+ The function below follows the structure of XXH3: the payload is read in stripes of 64 bytes by eight independent 64-bit lanes, each of which adds the
+ product of the two 32-bit halves of its input mixed with a secret, so the compiler can turn the inner loop into SIMD multiplies (pmuludq, vpmuludq or
+ umull); the lanes are scrambled every eight stripes and folded together with 128-bit multiplies at the end.
+ Payloads shorter than a stripe go through a shorter path of 16-byte multiplies.
+ It is fast but not keyed, so whoever chooses the keys can choose colliding ones; for keys that come from untrusted input, define NEWDATATYPE_SIPHASH to
+ use the seeded SipHash of str and bytes instead, through Py_HashBuffer() or, before Python 3.14, _Py_HashBytes().
+ Here the underlying datatype is assumed to keep its payload in data, of size bytes.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#define NEWDATATYPE_PRIME32_1 0x9E3779B1U
+#define NEWDATATYPE_PRIME32_2 0x85EBCA77U
+#define NEWDATATYPE_PRIME32_3 0xC2B2AE3DU
+#define NEWDATATYPE_PRIME64_1 0x9E3779B185EBCA87ULL
+#define NEWDATATYPE_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define NEWDATATYPE_PRIME64_3 0x165667B19E3779F9ULL
+#define NEWDATATYPE_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define NEWDATATYPE_PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define NEWDATATYPE_STRIPE 64
+#define NEWDATATYPE_BLOCK 8     /* stripes between scrambles */
+
+static const uint64_t newdatatype_secret[16] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+    0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL, 0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL,
+    0xCB00C391BB52283CULL, 0xA32E531B8B65D088ULL, 0x4EF90DA297486471ULL, 0xD8ACDEA946EF1938ULL,
+    0x3F349CE33F76FAA8ULL, 0x1D4F0BC7C7BBDCF9ULL, 0x3159B4CD4BE0518AULL, 0x647378D9C97E9FC8ULL,
+};
+
+static inline uint64_t
+
+newdatatype_read64(const unsigned char *p)
+
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline uint64_t
+
+newdatatype_read32(const unsigned char *p)
+
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+/* Multiply to 128 bits and fold the halves together */
+
+static inline uint64_t
+
+newdatatype_mix(uint64_t a, uint64_t b)
+
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t m = (__uint128_t) a * b;
+
+    return (uint64_t) m ^ (uint64_t) (m >> 64);
+#else
+    uint64_t lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF), hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    uint64_t lo_hi = (a & 0xFFFFFFFF) * (b >> 32), hi_hi = (a >> 32) * (b >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+
+    return ((cross << 32) | (lo_lo & 0xFFFFFFFF)) ^ (hi_hi + (hi_lo >> 32) + (cross >> 32));
+#endif
+}
+
+static inline uint64_t
+
+newdatatype_avalanche(uint64_t h)
+
+{
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+
+    return h;
+}
+
+static inline void
+
+newdatatype_accumulate(uint64_t acc[8], const unsigned char *stripe, const uint64_t *secret)
+
+{
+    uint64_t data[8];
+    int i;
+
+    for (i = 0; i < 8; i++)
+        data[i] = newdatatype_read64(stripe + 8 * i);
+
+    /* Each lane also adds the raw input of its neighbour, so that no input is lost when its product with the secret is zero */
+
+    for (i = 0; i < 8; i++) {
+        uint64_t key = data[i] ^ secret[i];
+
+        acc[i] += data[i ^ 1] + (key & 0xFFFFFFFF) * (key >> 32);
+    }
+}
+
+static inline void
+
+newdatatype_scramble(uint64_t acc[8], const uint64_t *secret)
+
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ secret[i]) * NEWDATATYPE_PRIME32_1;
+}
+
+static uint64_t
+
+newdatatype_hash_bytes(const unsigned char *p, size_t len)
+
+{
+    uint64_t h = len * NEWDATATYPE_PRIME64_1, lo = 0, hi = 0;
+    size_t i, stripes;
+
+    if (len < NEWDATATYPE_STRIPE) {
+        for (i = 0; len >= 16; p += 16, len -= 16, i += 2)
+            h += newdatatype_mix(newdatatype_read64(p) ^ newdatatype_secret[i], newdatatype_read64(p + 8) ^ newdatatype_secret[i + 1]);
+
+        /* The last 0 to 15 bytes, read as two words that may overlap */
+
+        if (len >= 8) {
+            lo = newdatatype_read64(p);
+            hi = newdatatype_read64(p + len - 8);
+        }
+        else if (len >= 4) {
+            lo = newdatatype_read32(p);
+            hi = newdatatype_read32(p + len - 4);
+        }
+        else if (len > 0)
+            lo = p[0] | (uint64_t) p[len / 2] << 8 | (uint64_t) p[len - 1] << 16;
+
+        h += newdatatype_mix(lo ^ newdatatype_secret[8], hi ^ newdatatype_secret[9]);
+
+        return newdatatype_avalanche(h);
+    }
+
+    {
+        uint64_t acc[8] = {
+            NEWDATATYPE_PRIME32_3, NEWDATATYPE_PRIME64_1, NEWDATATYPE_PRIME64_2, NEWDATATYPE_PRIME64_3,
+            NEWDATATYPE_PRIME64_4, NEWDATATYPE_PRIME32_2, NEWDATATYPE_PRIME64_5, NEWDATATYPE_PRIME32_1,
+        };
+
+        /* Every stripe but the last, which may be partial and is read as the last 64 bytes instead */
+
+        stripes = (len - 1) / NEWDATATYPE_STRIPE;
+
+        for (i = 0; i < stripes; i++) {
+            newdatatype_accumulate(acc, p + i * NEWDATATYPE_STRIPE, newdatatype_secret + i % NEWDATATYPE_BLOCK);
+
+            if (i % NEWDATATYPE_BLOCK == NEWDATATYPE_BLOCK - 1)
+                newdatatype_scramble(acc, newdatatype_secret + 8);
+        }
+
+        newdatatype_accumulate(acc, p + len - NEWDATATYPE_STRIPE, newdatatype_secret + 7);
+
+        for (i = 0; i < 8; i += 2)
+            h += newdatatype_mix(acc[i] ^ newdatatype_secret[i], acc[i + 1] ^ newdatatype_secret[i + 1]);
+    }
+
+    return newdatatype_avalanche(h);
+}
+
+/*
+ Hashing a large payload is not free, so the result is kept in the object, in a hash field that tp_new sets to -1, which is never a valid hash.
+ Every function that changes the payload has to drop it with NEWDATATYPE_INVALIDATE(); an object should not change while it is a key of a dict, but it
+ may be changed and then hashed again.
+ tp_richcompare has to compare the payloads too, since objects that compare equal must have equal hashes.
+*/
+
+#define NEWDATATYPE_INVALIDATE(obj) ((obj)->hash = -1)
+
+static Py_hash_t
+
+newdatatype_payload_hash(newdatatypeobject *obj)
+
+{
+    Py_hash_t result = obj->hash;
+
+    if (result != -1)
+        return result;
+
+#if defined(NEWDATATYPE_SIPHASH) && PY_VERSION_HEX >= 0x030E0000
+    result = Py_HashBuffer(obj->obj_UnderlyingDatatypePtr->data, obj->obj_UnderlyingDatatypePtr->size);
+#elif defined(NEWDATATYPE_SIPHASH)
+    result = _Py_HashBytes(obj->obj_UnderlyingDatatypePtr->data, obj->obj_UnderlyingDatatypePtr->size);
+#else
+    result = (Py_hash_t) newdatatype_hash_bytes(obj->obj_UnderlyingDatatypePtr->data, obj->obj_UnderlyingDatatypePtr->size);
+#endif
+
+    if (result == -1)
+       result = -2;
+
+    obj->hash = result;
+
+    return result;
+
+}
+
 ternaryfunc tp_call;
 
 /* 
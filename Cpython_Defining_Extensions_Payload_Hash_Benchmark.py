@@ -0,0 +1,140 @@
+# Cpython Defining Extensions.
+# Benchmark for hashing the payload of newdatatype (Abstract Protocol Support).
+# Builds N payloads the way a type with an underlying datatype tends to hold them: records of a few sizes, which share long prefixes and differ in a
+# counter, and hashes them three ways:
+# > "size + 32767 * number", the simple example, where number is the first byte of the payload;
+# > newdatatype_hash_bytes(), the XXH3-style hash, ported to Python below to produce the same values as the C code;
+# > the SipHash of the payload, which is hash(bytes(payload)), as used with NEWDATATYPE_SIPHASH.
+# For each it reports the fraction of distinct hashes, the fraction of keys whose first dict slot (the hash modulo the table size) is already taken by
+# an earlier key, and the dict lookup throughput with keys that return the precomputed hash, as the cached hash of the C type does; the cost of
+# computing the hashes themselves is that of the C functions and is not measured here.
+#
+
+import random
+import struct
+import timeit
+
+N = 50000
+
+MASK = (1 << 64) - 1
+
+PRIME32_1, PRIME32_2, PRIME32_3 = 0x9E3779B1, 0x85EBCA77, 0xC2B2AE3D
+PRIME64_1, PRIME64_2, PRIME64_3 = 0x9E3779B185EBCA87, 0xC2B2AE3D27D4EB4F, 0x165667B19E3779F9
+PRIME64_4, PRIME64_5 = 0x85EBCA77C2B2AE63, 0x27D4EB2F165667C5
+
+SECRET = [
+    0xBE4BA423396CFEB8, 0x1CAD21F72C81017C, 0xDB979083E96DD4DE, 0x1F67B3B7A4A44072,
+    0x78E5C0CC4EE679CB, 0x2172FFCC7DD05A82, 0x8E2443F7744608B8, 0x4C263A81E69035E0,
+    0xCB00C391BB52283C, 0xA32E531B8B65D088, 0x4EF90DA297486471, 0xD8ACDEA946EF1938,
+    0x3F349CE33F76FAA8, 0x1D4F0BC7C7BBDCF9, 0x3159B4CD4BE0518A, 0x647378D9C97E9FC8,
+]
+
+
+def mix(a, b):
+    m = a * b
+    return (m & MASK) ^ (m >> 64)
+
+
+def avalanche(h):
+    h ^= h >> 37
+    h = (h * 0x165667919E3779F9) & MASK
+    return h ^ (h >> 32)
+
+
+def accumulate(acc, p, offset, secret):
+    data = struct.unpack_from("<8Q", p, offset)
+
+    for i in range(8):
+        key = data[i] ^ SECRET[secret + i]
+        acc[i] = (acc[i] + data[i ^ 1] + (key & 0xFFFFFFFF) * (key >> 32)) & MASK
+
+
+def hash_bytes(p):
+    length = len(p)
+    h = (length * PRIME64_1) & MASK
+
+    if length < 64:
+        offset, i = 0, 0
+
+        while length - offset >= 16:
+            lo, hi = struct.unpack_from("<2Q", p, offset)
+            h = (h + mix(lo ^ SECRET[i], hi ^ SECRET[i + 1])) & MASK
+            offset += 16
+            i += 2
+
+        rest = length - offset
+        lo = hi = 0
+
+        if rest >= 8:
+            lo, hi = struct.unpack_from("<Q", p, offset)[0], struct.unpack_from("<Q", p, length - 8)[0]
+        elif rest >= 4:
+            lo, hi = struct.unpack_from("<I", p, offset)[0], struct.unpack_from("<I", p, length - 4)[0]
+        elif rest > 0:
+            lo = p[offset] | p[offset + rest // 2] << 8 | p[length - 1] << 16
+
+        h = (h + mix(lo ^ SECRET[8], hi ^ SECRET[9])) & MASK
+        return avalanche(h)
+
+    acc = [PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1]
+    stripes = (length - 1) // 64
+
+    for i in range(stripes):
+        accumulate(acc, p, i * 64, i % 8)
+
+        if i % 8 == 7:
+            acc = [((a ^ (a >> 47) ^ SECRET[8 + j]) * PRIME32_1) & MASK for j, a in enumerate(acc)]
+
+    accumulate(acc, p, length - 64, 7)
+
+    for i in range(0, 8, 2):
+        h = (h + mix(acc[i] ^ SECRET[i], acc[i + 1] ^ SECRET[i + 1])) & MASK
+
+    return avalanche(h)
+
+
+def as_py_hash(h):
+    h = h - (1 << 64) if h >= 1 << 63 else h
+    return -2 if h == -1 else h
+
+
+class Key:
+    __slots__ = ("payload", "hash")
+
+    def __init__(self, payload, h):
+        self.payload = payload
+        self.hash = h
+
+    def __hash__(self):
+        return self.hash
+
+    def __eq__(self, other):
+        return self.payload == other.payload
+
+
+random.seed(0)
+payloads = set()
+
+while len(payloads) < N:
+    size = random.choice([24, 40, 96, 200, 1000])
+    header = bytes([random.randrange(4)]) + b"\0" * 7
+    payloads.add(header + random.randrange(N).to_bytes(8, "little") + b"x" * (size - 16))
+
+payloads = list(payloads)
+table = 1 << (N * 3 // 2 - 1).bit_length()      # the size of the table of a dict with N keys
+
+for label, func in [
+    ("size + 32767 * number", lambda p: len(p) + 32767 * p[0]),
+    ("newdatatype_hash_bytes()", lambda p: as_py_hash(hash_bytes(p))),
+    ("SipHash (NEWDATATYPE_SIPHASH)", lambda p: hash(bytes(p))),
+]:
+    keys = [Key(p, func(p)) for p in payloads]
+    hashes = [k.hash for k in keys]
+    distinct = len(set(hashes)) / N
+    slots = 1 - len(set(h % table for h in hashes)) / N
+
+    d = dict.fromkeys(keys)
+    probes = keys[:5000] if distinct < 0.5 else keys
+    seconds = min(timeit.repeat(lambda: [k in d for k in probes], number=1, repeat=3))
+
+    print("%-30s distinct %6.2f%%  first-slot collisions %6.2f%%  %8.2f M lookups/s"
+          % (label, distinct * 100, slots * 100, len(probes) / seconds / 1e6))